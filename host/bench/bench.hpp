@@ -0,0 +1,65 @@
+#ifndef BTHOME_BENCH_HPP_
+#define BTHOME_BENCH_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//Timing helpers shared by the host benchmarks
+namespace BTHome::bench
+{
+    //keeps the compiler from optimizing a value or the stores behind a pointer away
+    template<class T>
+    inline void keep(const T &v) { asm volatile("" : : "g"(&v) : "memory"); }
+
+    //TSC ticks on x86, nanoseconds elsewhere
+    inline uint64_t ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    struct Result
+    {
+        double m_Ns;//per call
+        double m_Ticks;//per call, see ticks()
+    };
+
+    //best of a few rounds of n calls of f(i)
+    template<class F>
+    Result measure(F &&f, uint32_t n = 200000, int rounds = 5)
+    {
+        Result best{1e30, 1e30};
+        for(int r = 0; r < rounds; ++r)
+        {
+            const auto t0 = std::chrono::steady_clock::now();
+            const uint64_t c0 = ticks();
+            for(uint32_t i = 0; i < n; ++i)
+                f(i);
+            const uint64_t c1 = ticks();
+            const auto t1 = std::chrono::steady_clock::now();
+            const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+            if (ns < best.m_Ns)
+                best = {ns, double(c1 - c0) / n};
+        }
+        return best;
+    }
+
+    //check that fails the benchmark (and its ctest run) if an assumption behind the numbers is off
+    inline int g_Failures = 0;
+    inline void expect(bool ok, const char *what)
+    {
+        if (ok)
+            return;
+        std::printf("FAILED: %s\n", what);
+        ++g_Failures;
+    }
+}
+
+#endif
@@ -0,0 +1,87 @@
+//update<X>() cost, pack construction, frames per advertise cycle and advertise duration
+//for representative sensor sets, on the host shim
+#include "bthome/bthome_comp.hpp"
+#include "bthome_shim.hpp"
+#include "bench.hpp"
+
+using namespace BTHome;
+
+namespace
+{
+    using Small = decltype(Advertisement("bench", Flags::None, Temperature{}, Humidity{}, Battery{}));
+    using Medium = decltype(Advertisement("bench", Flags::None, Temperature{}, Humidity{}, Pressure{}, Illuminance{}, Battery{},
+        CO2{}, TVOC{}, PM2_5{}, PM10{}, VoltageFine{}));
+    #define BTHOME_BENCH_LARGE_SET Temperature{}, Humidity{}, Pressure{}, Illuminance{}, Battery{}, CO2{}, TVOC{}, PM2_5{}, \
+        PM10{}, VoltageFine{}, Current{}, Power{}, Energy{}, Count4{}, Dewpoint{}, MassKg{}, Moisture{}, Water{}, Gas{}, \
+        Duration{}, Speed{}, Rotation{}, UVIndex{}, Volume{}, Precipitation{}
+    using Large = decltype(Advertisement("bench", Flags::None, BTHOME_BENCH_LARGE_SET));
+    using LargeExt = decltype(ExtAdvertisement("bench", Flags::None, BTHOME_BENCH_LARGE_SET));
+
+    const bt_le_adv_param kParam = BT_LE_ADV_PARAM_INIT(AdvOptions::kDefaultAdvOpt, BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, nullptr);
+    const bt_le_adv_param kExtParam = BT_LE_ADV_PARAM_INIT(ExtAdvOptions::kDefaultAdvOpt, BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, nullptr);
+
+    constexpr int kSlotMs = 1000;
+
+    size_t data_frames()
+    {
+        size_t n = 0;
+        for(const auto &f : shim::frames())
+            n += f.has_data();
+        return n;
+    }
+
+    //First: the type of the first object, the one being updated
+    template<class Adv, class First>
+    void run(const char *name, const bt_le_adv_param &param)
+    {
+        const auto ctor = bench::measure([](uint32_t){
+            Adv a("bench", Flags::None);
+            bench::keep(a);
+        });
+
+        static Adv adv("bench", Flags::None);
+        const auto update = bench::measure([](uint32_t i){
+            bench::keep(adv.template update<First>(float(i & 15) * 0.25f));
+        });
+        const auto same = bench::measure([](uint32_t){
+            bench::keep(adv.template update<First>(1.f));
+        });
+
+        //CPU time of a whole cycle, frames not stored
+        shim::reset();
+        shim::record_frames(false);
+        const auto cycle = bench::measure([&](uint32_t i){
+            adv.template update<First>(float(i & 15) * 0.25f);
+            adv.advertise_with(&param, kSlotMs);
+        }, 2000, 3);
+
+        shim::reset();
+        adv.advertise_with(&param, kSlotMs);
+        const size_t frames = data_frames();
+        const int64_t cycleMs = shim::now_us() / 1000;
+        const int64_t onAirMs = shim::on_air_us() / 1000;
+
+        shim::reset();
+        adv.template update<First>(5.f);
+        adv.advertise_changed();
+        const size_t changedFrames = data_frames();
+
+        std::printf("%-9s %4zu %5zu %8.1f %9.2f %9.2f %9.0f %6zu %8lld %9lld %7zu\n", name, Adv::AdvLayout::kObjects, Adv::kPacksCount,
+            ctor.m_Ns, update.m_Ns, same.m_Ns, cycle.m_Ns, frames, (long long)cycleMs, (long long)onAirMs, changedFrames);
+
+        bench::expect(frames == Adv::kPacksCount, "advertise_with hands every pack over once");
+        bench::expect(cycleMs == int64_t(Adv::kPacksCount) * kSlotMs, "advertise_with takes a slot per pack");
+        bench::expect(changedFrames == 1, "advertise_changed sends only the updated pack");
+    }
+}
+
+int main()
+{
+    std::printf("%-9s %4s %5s %8s %9s %9s %9s %6s %8s %9s %7s\n", "set", "objs", "packs", "ctor ns", "update ns", "same ns",
+        "cycle ns", "frames", "cycle ms", "on-air ms", "changed");
+    run<Small, Temperature>("small", kParam);
+    run<Medium, Temperature>("medium", kParam);
+    run<Large, Temperature>("large", kParam);
+    run<LargeExt, Temperature>("large-ext", kExtParam);
+    return bench::g_Failures ? 1 : 0;
+}
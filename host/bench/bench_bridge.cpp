@@ -0,0 +1,103 @@
+//Bridge capacity on the shim: for pack counts and refresh periods, the most devices one node keeps
+//on schedule (no refresh late), against BridgeSchedule::Capacity, and the CPU time per slot
+#include "bthome/bthome_bridge.hpp"
+#include "bthome_shim.hpp"
+#include "bench.hpp"
+#include <chrono>
+#include <deque>
+#include <memory>
+
+using namespace BTHome;
+
+namespace
+{
+    using OnePack = decltype(Advertisement("bench", Flags::None, Temperature{}, Humidity{}, Battery{}));
+    using TwoPacks = decltype(Advertisement("bench", Flags::None, Temperature{}, Humidity{}, Pressure{}, Illuminance{}, Battery{},
+        CO2{}, TVOC{}, PM2_5{}, PM10{}, VoltageFine{}));
+    using ThreePacks = decltype(Advertisement("bench", Flags::None, Temperature{}, Humidity{}, Pressure{}, Illuminance{}, Battery{},
+        CO2{}, TVOC{}, PM2_5{}, PM10{}, VoltageFine{}, Current{}, Power{}));
+    static_assert(OnePack::kPacksCount == 1 && TwoPacks::kPacksCount == 2 && ThreePacks::kPacksCount == 3);
+
+    constexpr size_t kMaxDevices = 640;
+    constexpr int kSlotMs = 100;
+    constexpr int kPeriods = 5;
+
+    struct Run
+    {
+        size_t m_Misses = 0;
+        uint64_t m_Refreshes = 0;
+        double m_NsPerSlot = 0;
+    };
+
+    //n devices added at once (the worst burst), kPeriods refresh periods
+    template<class Adv>
+    Run simulate(size_t n, int period_ms)
+    {
+        static std::deque<Adv> advs;
+        while(advs.size() < n)
+            advs.emplace_back("bench", Flags::None);
+
+        shim::reset();
+        shim::record_frames(false);
+        auto pBridge = std::make_unique<Bridge<kMaxDevices>>(BridgeConfig{kSlotMs});
+        for(size_t i = 0; i < n; ++i)
+            pBridge->add(advs[i], 0, period_ms);
+        pBridge->start();
+
+        const auto t0 = std::chrono::steady_clock::now();
+        shim::run_for(int64_t(period_ms) * kPeriods);
+        const auto t1 = std::chrono::steady_clock::now();
+        pBridge->stop();
+
+        Run r;
+        for(size_t i = 0; i < n; ++i)
+        {
+            r.m_Misses += pBridge->schedule().misses(i);
+            r.m_Refreshes += pBridge->schedule().refreshes(i);
+        }
+        const size_t slots = shim::count(shim::Call::AdvStart);
+        r.m_NsPerSlot = slots ? std::chrono::duration<double, std::nano>(t1 - t0).count() / double(slots) : 0;
+        return r;
+    }
+
+    template<class Adv>
+    void run(int period_ms)
+    {
+        //the largest n without a late refresh
+        size_t lo = 0, hi = kMaxDevices;
+        while(lo < hi)
+        {
+            const size_t mid = (lo + hi + 1) / 2;
+            if (simulate<Adv>(mid, period_ms).m_Misses)
+                hi = mid - 1;
+            else
+                lo = mid;
+        }
+
+        const size_t expected = BridgeSchedule<kMaxDevices>::Capacity(Adv::kPacksCount, period_ms, kSlotMs);
+        const Run atMax = simulate<Adv>(lo, period_ms);
+        const Run over = simulate<Adv>(lo + 1, period_ms);
+        std::printf("%5zu %8d %9zu %9zu %9llu %11zu %10.0f\n", Adv::kPacksCount, period_ms / 1000, expected, lo,
+            (unsigned long long)atMax.m_Refreshes, over.m_Misses, atMax.m_NsPerSlot);
+
+        bench::expect(lo == expected, "measured capacity matches BridgeSchedule::Capacity");
+        bench::expect(atMax.m_Refreshes >= uint64_t(lo) * (kPeriods - 1), "every device refreshes once per period");
+    }
+
+    template<class Adv>
+    void run_periods()
+    {
+        for(int period_s : {5, 10, 30, 60})
+            run<Adv>(period_s * 1000);
+    }
+}
+
+int main()
+{
+    std::printf("bridge capacity, %d ms slots, %d periods\n", kSlotMs, kPeriods);
+    std::printf("%5s %8s %9s %9s %9s %11s %10s\n", "packs", "period s", "capacity", "measured", "refreshes", "misses at+1", "ns/slot");
+    run_periods<OnePack>();
+    run_periods<TwoPacks>();
+    run_periods<ThreePacks>();
+    return bench::g_Failures ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+//decoder throughput (frames/s, objects/s) on the frames the encoder sends for representative sensor sets
+#include "bthome/bthome_comp.hpp"
+#include "bthome/bthome_decoder.hpp"
+#include "bthome_shim.hpp"
+#include "bench.hpp"
+#include <vector>
+
+using namespace BTHome;
+
+namespace
+{
+    using Small = decltype(Advertisement("bench", Flags::None, Temperature{}, Humidity{}, Battery{}));
+    using Medium = decltype(Advertisement("bench", Flags::None, Temperature{}, Humidity{}, Pressure{}, Illuminance{}, Battery{},
+        CO2{}, TVOC{}, PM2_5{}, PM10{}, VoltageFine{}));
+    using Large = decltype(Advertisement("bench", Flags::None, Temperature{}, Humidity{}, Pressure{}, Illuminance{}, Battery{},
+        CO2{}, TVOC{}, PM2_5{}, PM10{}, VoltageFine{}, Current{}, Power{}, Energy{}, Count4{}, Dewpoint{}, MassKg{}, Moisture{},
+        Water{}, Gas{}, Duration{}, Speed{}, Rotation{}, UVIndex{}, Volume{}, Precipitation{}));
+
+    //the service data of every pack, as a gateway receives it
+    template<class Adv>
+    std::vector<std::vector<uint8_t>> capture()
+    {
+        static Adv adv("bench", Flags::None);
+        const bt_le_adv_param param = BT_LE_ADV_PARAM_INIT(AdvOptions::kDefaultAdvOpt, BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, nullptr);
+        shim::reset();
+        adv.advertise_with(&param, 100);
+        std::vector<std::vector<uint8_t>> res;
+        for(const auto &f : shim::frames())
+            if (f.has_data())
+                res.push_back(f.service_data());
+        return res;
+    }
+
+    template<class Adv>
+    void run(const char *name)
+    {
+        const auto packs = capture<Adv>();
+        const size_t n = packs.size();
+
+        size_t objects = 0;
+        bool ok = true;
+        for(const auto &p : packs)
+            ok &= decoder::decode(p.data(), p.size(), [&](const decoder::Object &){ ++objects; }) == decoder::Error::Ok;
+
+        const auto visit = bench::measure([&](uint32_t i){
+            const auto &p = packs[i % n];
+            double sum = 0;
+            decoder::decode(p.data(), p.size(), [&](const decoder::Object &o){ sum += o.value(); });
+            bench::keep(sum);
+        });
+
+        const auto array = bench::measure([&](uint32_t i){
+            const auto &p = packs[i % n];
+            decoder::Object res[32];
+            size_t count;
+            bench::keep(decoder::decode(p.data(), p.size(), res, count));
+            bench::keep(res);
+        });
+
+        const double objsPerFrame = double(objects) / double(n);
+        std::printf("%-7s %5zu %6.1f %10.1f %12.0f %12.0f %10.1f %12.0f\n", name, n, objsPerFrame,
+            visit.m_Ns, 1e9 / visit.m_Ns, 1e9 / visit.m_Ns * objsPerFrame, array.m_Ns, 1e9 / array.m_Ns);
+
+        bench::expect(n == Adv::kPacksCount, "one frame per pack");
+        bench::expect(ok, "every frame decodes");
+        bench::expect(objects == Adv::AdvLayout::kObjects, "every object comes back");
+    }
+}
+
+int main()
+{
+    std::printf("%-7s %5s %6s %10s %12s %12s %10s %12s\n", "set", "packs", "obj/fr", "visit ns", "frames/s", "objects/s",
+        "array ns", "frames/s");
+    run<Small>("small");
+    run<Medium>("medium");
+    run<Large>("large");
+    return bench::g_Failures ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+//cycles per encode: float values against the integer update_scaled path, for the kernels alone and
+//through update<X>() (lookup, change detection, dirty marking).
+//On the host the FPU hides most of the gap; on FPU-less MCUs the float path goes through soft-float.
+#include "bthome/bthome_comp.hpp"
+#include "bench.hpp"
+
+using namespace BTHome;
+
+namespace
+{
+    using Adv = decltype(Advertisement("bench", Flags::None, Temperature{}, Humidity{}, Pressure{}, Power{}, Energy{}, VoltageFine{}));
+
+    Adv g_Adv("bench", Flags::None);
+
+    template<class X>
+    void run(const char *name)
+    {
+        uint8_t buf[4] = {};
+        const auto kernelFloat = bench::measure([&](uint32_t i){
+            X::convert_from(float(i & 1023) / X::kFactor, buf);
+            bench::keep(buf);
+        });
+        const auto kernelScaled = bench::measure([&](uint32_t i){
+            X::convert_from(Scaled{int32_t(i & 1023)}, buf);
+            bench::keep(buf);
+        });
+        const auto updFloat = bench::measure([](uint32_t i){
+            bench::keep(g_Adv.template update<X>(float(i & 1023) / X::kFactor));
+        });
+        const auto updScaled = bench::measure([](uint32_t i){
+            bench::keep(g_Adv.template update_scaled<X>(int32_t(i & 1023)));
+        });
+
+        std::printf("%-12s %8.1f %8.1f %8.2f %10.1f %10.1f %8.2f\n", name, kernelFloat.m_Ticks, kernelScaled.m_Ticks,
+            kernelFloat.m_Ticks / kernelScaled.m_Ticks, updFloat.m_Ticks, updScaled.m_Ticks, updFloat.m_Ticks / updScaled.m_Ticks);
+
+        //both paths put the same bytes on air
+        bool same = true;
+        for(int32_t v = 0; v < 1024; ++v)
+        {
+            uint8_t a[4] = {}, b[4] = {};
+            X::convert_from(float(v) / X::kFactor, a);
+            X::convert_from(Scaled{v}, b);
+            same &= a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3];
+        }
+        bench::expect(same, "float and scaled encodings match");
+    }
+}
+
+int main()
+{
+    std::printf("%-12s %8s %8s %8s %10s %10s %8s\n", "type", "float", "scaled", "ratio", "upd float", "upd scaled", "ratio");
+    std::printf("%-12s %8s %8s %8s %10s %10s %8s\n", "", "ticks", "ticks", "", "ticks", "ticks", "");
+    run<Temperature>("temperature");
+    run<Humidity>("humidity");
+    run<Pressure>("pressure");
+    run<Power>("power");
+    run<Energy>("energy");
+    run<VoltageFine>("voltage");
+    return bench::g_Failures ? 1 : 0;
+}
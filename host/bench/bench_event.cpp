@@ -0,0 +1,92 @@
+//send_event latency on the shim: virtual time from the call to the controller hand-off and back to the
+//rotation, at every point of a running async cycle, and the CPU cost of an event
+#include "bthome/bthome_comp.hpp"
+#include "bthome_shim.hpp"
+#include "bench.hpp"
+
+using namespace BTHome;
+using shim::Call;
+
+namespace
+{
+    using Adv = BasicAdvertisement<WithEvents<>, sizeof("bench"), Temperature, Humidity, Pressure, Illuminance, Battery,
+        CO2, TVOC, PM2_5, PM10, VoltageFine>;
+
+    const bt_le_adv_param kParam = BT_LE_ADV_PARAM_INIT(AdvOptions::kDefaultAdvOpt, BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, nullptr);
+    constexpr int kSlotMs = 1000;
+    constexpr int kBurstMs = 500;
+    constexpr int kCycleMs = int(Adv::kPacksCount) * kSlotMs;
+
+    Adv g_Adv("bench", Flags::None);
+
+    //first frame of kind c at or after fromUs
+    int64_t first(Call c, int64_t fromUs)
+    {
+        for(const auto &f : shim::frames())
+            if (f.m_Call == c && f.m_TimeUs >= fromUs)
+                return f.m_TimeUs;
+        return -1;
+    }
+}
+
+int main()
+{
+    int64_t worstHandOffUs = 0, worstResumeUs = 0, worstStretchUs = 0, samples = 0;
+    bool allDone = true;
+    for(int offsetMs = 1; offsetMs < kCycleMs; offsetMs += 37)
+    {
+        shim::reset();
+        static int done = 0;
+        done = 0;
+        g_Adv.advertise_with_async(&kParam, kSlotMs, [](void*){ ++done; });
+        shim::run_for(offsetMs);
+
+        const int64_t sentUs = shim::now_us();
+        g_Adv.send_event<Button>(EButton::Press, kBurstMs);
+        shim::run_until_idle(10 * kCycleMs);
+
+        //the burst is the start at the fast interval, the rotation resumes with the next start after it
+        int64_t burstUs = -1;
+        for(const auto &f : shim::frames())
+            if (f.m_Call == Call::AdvStart && f.m_TimeUs >= sentUs && f.m_Param.interval_min == AdvOptions::kEventIntMin)
+            {
+                burstUs = f.m_TimeUs;
+                break;
+            }
+        const int64_t resumedUs = first(Call::AdvStart, burstUs + 1);
+        const int64_t handOff = burstUs - sentUs;
+        const int64_t resume = resumedUs - (burstUs + kBurstMs * 1000);
+        const int64_t stretch = shim::now_us() - int64_t(kCycleMs) * 1000;
+        worstHandOffUs = handOff > worstHandOffUs ? handOff : worstHandOffUs;
+        worstResumeUs = resume > worstResumeUs ? resume : worstResumeUs;
+        worstStretchUs = stretch > worstStretchUs ? stretch : worstStretchUs;
+        allDone &= done == 1 && burstUs >= 0 && resumedUs >= 0;
+        ++samples;
+    }
+
+    //first event PDU after the hand-off: an advertising interval plus advDelay (up to 10 ms) in the worst case
+    const double firstPduMs = AdvOptions::kEventIntMax * 0.625 + 10;
+
+    //send_event plus the burst start on the work queue, and the burst end
+    shim::reset();
+    shim::record_frames(false);
+    const auto cpu = bench::measure([](uint32_t i){
+        g_Adv.send_event<Button>(EButton(1 + (i & 3)), kBurstMs);
+        shim::run_for(0);
+    }, 20000);
+    shim::run_until_idle(10 * kBurstMs);
+
+    std::printf("%-22s %10s\n", "event latency", "");
+    std::printf("%-22s %10lld\n", "samples", (long long)samples);
+    std::printf("%-22s %10.3f ms\n", "worst hand-off", worstHandOffUs / 1000.);
+    std::printf("%-22s %10.1f ms\n", "worst first PDU", worstHandOffUs / 1000. + firstPduMs);
+    std::printf("%-22s %10.3f ms\n", "worst resume", worstResumeUs / 1000.);
+    std::printf("%-22s %10.1f ms\n", "worst cycle stretch", worstStretchUs / 1000.);
+    std::printf("%-22s %10.1f ns\n", "cpu per event", cpu.m_Ns);
+
+    bench::expect(allDone, "every burst resumed the rotation and the cycle completed");
+    bench::expect(worstHandOffUs == 0, "the event is handed over in the same tick");
+    bench::expect(worstResumeUs == 0, "the rotation resumes as soon as the burst ends");
+    bench::expect(worstStretchUs <= (kBurstMs + kSlotMs) * 1000, "a burst delays the cycle by at most itself and a slot");
+    return bench::g_Failures ? 1 : 0;
+}
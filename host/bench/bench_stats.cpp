@@ -0,0 +1,61 @@
+//WithStats cost: the same sensor set with and without the stats policy, object size and the
+//update<X>()/advertise cycle paths. Without it nothing may be left, not even an empty member.
+#include "bthome/bthome_comp.hpp"
+#include "bthome_shim.hpp"
+#include "bench.hpp"
+#include <type_traits>
+
+using namespace BTHome;
+
+namespace
+{
+    #define BTHOME_BENCH_SET Temperature, Humidity, Pressure, Illuminance, Battery, CO2, TVOC, PM2_5, PM10, VoltageFine
+    using Off = BasicAdvertisement<AdvOptions, sizeof("bench"), BTHOME_BENCH_SET>;
+    using On = BasicAdvertisement<WithStats<>, sizeof("bench"), BTHOME_BENCH_SET>;
+
+    static_assert(std::is_empty_v<decltype(Off::m_Stats)>, "Stats state is compiled in without WithStats");
+    static_assert(sizeof(Off) < sizeof(On));
+
+    const bt_le_adv_param kParam = BT_LE_ADV_PARAM_INIT(AdvOptions::kDefaultAdvOpt, BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, nullptr);
+
+    struct Row
+    {
+        bench::Result m_Update;
+        bench::Result m_Same;
+        bench::Result m_Cycle;
+    };
+
+    template<class Adv>
+    Row run()
+    {
+        static Adv adv("bench", Flags::None);
+        Row r;
+        r.m_Update = bench::measure([](uint32_t i){
+            bench::keep(adv.template update<Temperature>(float(i & 1023) * 0.01f));
+        });
+        r.m_Same = bench::measure([](uint32_t){
+            bench::keep(adv.template update<Temperature>(1.f));
+        });
+        shim::reset();
+        shim::record_frames(false);
+        r.m_Cycle = bench::measure([](uint32_t i){
+            adv.template update<Temperature>(float(i & 1023) * 0.01f);
+            adv.advertise_with(&kParam, 100);
+        }, 5000);
+        if constexpr (Adv::OptionsType::kStats)
+            bench::expect(adv.stats().m_Cycles > 0, "stats are counted");
+        return r;
+    }
+}
+
+int main()
+{
+    const Row off = run<Off>();
+    const Row on = run<On>();
+    std::printf("%-14s %10s %10s %10s\n", "", "stats off", "stats on", "delta");
+    std::printf("%-14s %10zu %10zu %10zd\n", "sizeof", sizeof(Off), sizeof(On), ssize_t(sizeof(On)) - ssize_t(sizeof(Off)));
+    std::printf("%-14s %10.2f %10.2f %+10.2f\n", "update ns", off.m_Update.m_Ns, on.m_Update.m_Ns, on.m_Update.m_Ns - off.m_Update.m_Ns);
+    std::printf("%-14s %10.2f %10.2f %+10.2f\n", "same ns", off.m_Same.m_Ns, on.m_Same.m_Ns, on.m_Same.m_Ns - off.m_Same.m_Ns);
+    std::printf("%-14s %10.1f %10.1f %+10.1f\n", "cycle ns", off.m_Cycle.m_Ns, on.m_Cycle.m_Ns, on.m_Cycle.m_Ns - off.m_Cycle.m_Ns);
+    return bench::g_Failures ? 1 : 0;
+}
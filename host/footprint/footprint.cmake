@@ -0,0 +1,55 @@
+#Reports .text and .rodata of the footprint variants and what each added object type costs.
+#-DSIZE=<size tool> -DTYPES=1|2|... -DOBJECTS=<object of TYPES[0]>|<object of TYPES[1]>|...
+string(REPLACE "|" ";" types "${TYPES}")
+string(REPLACE "|" ";" objects "${OBJECTS}")
+
+#sums the sizes of the sections starting with prefix (.text.* with -ffunction-sections)
+function(section_size out lines prefix)
+    set(total 0)
+    foreach(line IN LISTS lines)
+        if(line MATCHES "^(\\${prefix}[^ \t]*)[ \t]+([0-9]+)")
+            math(EXPR total "${total} + ${CMAKE_MATCH_2}")
+        endif()
+    endforeach()
+    set(${out} ${total} PARENT_SCOPE)
+endfunction()
+
+message("types   .text  .rodata   +.text/type  +.rodata/type")
+set(prevTypes "")
+foreach(t obj IN ZIP_LISTS types objects)
+    execute_process(COMMAND ${SIZE} -A -d ${obj} OUTPUT_VARIABLE out RESULT_VARIABLE res)
+    if(NOT res EQUAL 0)
+        message(FATAL_ERROR "${SIZE} failed on ${obj}")
+    endif()
+    string(REPLACE "\n" ";" lines "${out}")
+    section_size(text "${lines}" ".text")
+    section_size(rodata "${lines}" ".rodata")
+
+    set(dText "")
+    set(dRodata "")
+    if(prevTypes)
+        math(EXPR added "${t} - ${prevTypes}")
+        math(EXPR dText "(${text} - ${prevText}) / ${added}")
+        math(EXPR dRodata "(${rodata} - ${prevRodata}) / ${added}")
+    endif()
+    string(LENGTH "${t}" l0)
+    string(LENGTH "${text}" l1)
+    string(LENGTH "${rodata}" l2)
+    string(LENGTH "${dText}" l3)
+    string(LENGTH "${dRodata}" l4)
+    math(EXPR p0 "5 - ${l0}")
+    math(EXPR p1 "8 - ${l1}")
+    math(EXPR p2 "9 - ${l2}")
+    math(EXPR p3 "14 - ${l3}")
+    math(EXPR p4 "15 - ${l4}")
+    string(REPEAT " " ${p0} s0)
+    string(REPEAT " " ${p1} s1)
+    string(REPEAT " " ${p2} s2)
+    string(REPEAT " " ${p3} s3)
+    string(REPEAT " " ${p4} s4)
+    message("${s0}${t}${s1}${text}${s2}${rodata}${s3}${dText}${s4}${dRodata}")
+
+    set(prevTypes ${t})
+    set(prevText ${text})
+    set(prevRodata ${rodata})
+endforeach()
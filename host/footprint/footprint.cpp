@@ -0,0 +1,32 @@
+//Code size per object type: an advertisement with the first BTHOME_FOOTPRINT_TYPES types of the pool,
+//each one updated, and the advertise cycle. Built at -Os by the bthome_footprint_<N> targets,
+//the bthome_footprint target compares their sections (see footprint.cmake).
+#include "bthome/bthome_comp.hpp"
+#include <tuple>
+
+using namespace BTHome;
+
+namespace
+{
+    //different wire types and factors, so every step may add an encode path
+    using Pool = std::tuple<Temperature, Humidity, Battery, Pressure, Illuminance, CO2, Count4, Power,
+        VoltageFine, Energy, Count1, MassKg, Current, Dewpoint, Rotation, UVIndex>;
+
+    template<size_t... I>
+    auto make(std::index_sequence<I...>) -> decltype(Advertisement("footprint", Flags::None, std::tuple_element_t<I, Pool>{}...));
+
+    using Adv = decltype(make(std::make_index_sequence<BTHOME_FOOTPRINT_TYPES>{}));
+    Adv g_Adv("footprint", Flags::None);
+
+    template<size_t... I>
+    void update_all(std::index_sequence<I...>, int v)
+    {
+        (g_Adv.update<std::tuple_element_t<I, Pool>>(v), ...);
+    }
+}
+
+[[gnu::used]] int bthome_footprint_entry(const bt_le_adv_param *pParam, int v)
+{
+    update_all(std::make_index_sequence<BTHOME_FOOTPRINT_TYPES>{}, v);
+    return g_Adv.advertise_with(pParam, 100);
+}
@@ -0,0 +1,65 @@
+#ifndef BTHOME_SHIM_HPP_
+#define BTHOME_SHIM_HPP_
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <cstdint>
+#include <vector>
+
+//Control and inspection of the host stand-in for zephyr (host/include/zephyr):
+//the virtual clock, the work queue and everything handed to the "controller".
+namespace BTHome::shim
+{
+    enum class Call: uint8_t
+    {
+        AdvStart, AdvUpdate, AdvStop,
+        ExtCreate, ExtUpdateParam, ExtSetData, ExtStart, ExtStop, ExtDelete,
+        PerSetParam, PerSetData, PerStart, PerStop,
+        Count
+    };
+
+    //a successful bt_le_* call; m_Adv/m_Scan hold the AD structures as they go on air
+    struct Frame
+    {
+        int64_t m_TimeUs;
+        Call m_Call;
+        const bt_le_ext_adv *m_pSet;//null for legacy advertising
+        bt_le_adv_param m_Param;//for AdvStart, ExtCreate and ExtUpdateParam
+        std::vector<uint8_t> m_Adv;
+        std::vector<uint8_t> m_Scan;
+
+        bool has_data() const { return !m_Adv.empty(); }
+        //the service data structure (from the UUID on) in m_Adv, empty if there's none
+        std::vector<uint8_t> service_data() const;
+    };
+
+    //clock back to 0, work queue, frames, advertising and failures cleared; created sets are kept but stopped
+    void reset();
+
+    int64_t now_us();
+    //the calling thread sleeping: work items run as they become due
+    void run_for(int64_t ms);
+    //runs work items until none is queued or max_ms passed; returns true if the queue drained
+    bool run_until_idle(int64_t max_ms);
+    size_t queued_work();
+
+    const std::vector<Frame>& frames();
+    //successful calls of a kind since reset(), counted even while recording is off
+    size_t count(Call c);
+    //off for long simulations: frames aren't stored, only counted
+    void record_frames(bool on);
+
+    //the next times calls of kind c fail with err, without effect
+    void fail_next(Call c, int err, unsigned times = 1);
+
+    //advertising time summed over the legacy advertiser and every set
+    int64_t on_air_us();
+    bool legacy_advertising();
+
+    //settings storage (CONFIG_SETTINGS), kept across reset() like flash across a reboot
+    void clear_settings();
+    //successful settings_save_one calls since clear_settings()
+    size_t settings_writes();
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef BTHOME_HOST_ZEPHYR_BLUETOOTH_BLUETOOTH_H_
+#define BTHOME_HOST_ZEPHYR_BLUETOOTH_BLUETOOTH_H_
+
+//Host stand-in for the advertising API of zephyr/bluetooth/bluetooth.h.
+//The calls are recorded by the shim (bthome_shim.hpp) instead of reaching a controller.
+#include <cstddef>
+#include <cstdint>
+
+#define BT_DATA_FLAGS 0x01
+#define BT_DATA_NAME_COMPLETE 0x09
+#define BT_DATA_SVC_DATA16 0x16
+
+#define BT_LE_AD_GENERAL 0x02
+#define BT_LE_AD_NO_BREDR 0x04
+
+#define BT_GAP_ADV_FAST_INT_MIN_1 0x0030
+#define BT_GAP_ADV_FAST_INT_MAX_1 0x0060
+#define BT_GAP_ADV_SLOW_INT_MIN 0x0640
+#define BT_GAP_ADV_SLOW_INT_MAX 0x0780
+
+#define BT_LE_ADV_OPT_NONE 0
+#define BT_LE_ADV_OPT_CONNECTABLE (1u << 0)
+#define BT_LE_ADV_OPT_USE_IDENTITY (1u << 2)
+#define BT_LE_ADV_OPT_SCANNABLE (1u << 9)
+#define BT_LE_ADV_OPT_EXT_ADV (1u << 10)
+
+#define BT_ID_DEFAULT 0
+
+struct bt_data
+{
+    uint8_t type;
+    uint8_t data_len;
+    const uint8_t *data;
+};
+
+#define BT_DATA(_type, _data, _data_len) { .type = (_type), .data_len = (_data_len), .data = (const uint8_t *)(_data) }
+
+typedef struct { uint8_t val[6]; } bt_addr_t;
+typedef struct { uint8_t type; bt_addr_t a; } bt_addr_le_t;
+
+struct bt_le_adv_param
+{
+    uint8_t id;
+    uint8_t sid;
+    uint8_t secondary_max_skip;
+    uint32_t options;
+    uint32_t interval_min;
+    uint32_t interval_max;
+    const bt_addr_le_t *peer;
+};
+
+#define BT_LE_ADV_PARAM_INIT(_options, _int_min, _int_max, _peer) \
+    { .id = BT_ID_DEFAULT, .sid = 0, .secondary_max_skip = 0, .options = (_options), \
+      .interval_min = (_int_min), .interval_max = (_int_max), .peer = (_peer) }
+
+int bt_le_adv_start(const struct bt_le_adv_param *param, const struct bt_data *ad, size_t ad_len, const struct bt_data *sd, size_t sd_len);
+int bt_le_adv_update_data(const struct bt_data *ad, size_t ad_len, const struct bt_data *sd, size_t sd_len);
+int bt_le_adv_stop();
+
+struct bt_le_ext_adv;
+struct bt_le_ext_adv_cb;
+
+struct bt_le_ext_adv_start_param
+{
+    uint16_t timeout;
+    uint8_t num_events;
+};
+
+#define BT_LE_EXT_ADV_START_PARAM_INIT(_timeout, _n_evts) { .timeout = (_timeout), .num_events = (_n_evts) }
+
+//same compound literal as zephyr: C++ rejects passing it ("taking address of temporary array"),
+//so code using it fails on the host the way it would against the real headers
+#define BT_LE_EXT_ADV_START_PARAM(_timeout, _n_evts) \
+    ((struct bt_le_ext_adv_start_param[]) { BT_LE_EXT_ADV_START_PARAM_INIT((_timeout), (_n_evts)) })
+#define BT_LE_EXT_ADV_START_DEFAULT BT_LE_EXT_ADV_START_PARAM(0, 0)
+
+int bt_le_ext_adv_create(const struct bt_le_adv_param *param, const struct bt_le_ext_adv_cb *cb, struct bt_le_ext_adv **adv);
+int bt_le_ext_adv_update_param(struct bt_le_ext_adv *adv, const struct bt_le_adv_param *param);
+int bt_le_ext_adv_set_data(struct bt_le_ext_adv *adv, const struct bt_data *ad, size_t ad_len, const struct bt_data *sd, size_t sd_len);
+int bt_le_ext_adv_start(struct bt_le_ext_adv *adv, const struct bt_le_ext_adv_start_param *param);
+int bt_le_ext_adv_stop(struct bt_le_ext_adv *adv);
+int bt_le_ext_adv_delete(struct bt_le_ext_adv *adv);
+
+struct bt_le_per_adv_param
+{
+    uint16_t interval_min;
+    uint16_t interval_max;
+    uint32_t options;
+};
+
+#define BT_LE_PER_ADV_PARAM_INIT(_int_min, _int_max, _options) \
+    { .interval_min = (_int_min), .interval_max = (_int_max), .options = (_options) }
+
+int bt_le_per_adv_set_param(struct bt_le_ext_adv *adv, const struct bt_le_per_adv_param *param);
+int bt_le_per_adv_set_data(const struct bt_le_ext_adv *adv, const struct bt_data *ad, size_t ad_len);
+int bt_le_per_adv_start(struct bt_le_ext_adv *adv);
+int bt_le_per_adv_stop(struct bt_le_ext_adv *adv);
+
+int bt_id_create(bt_addr_le_t *addr, uint8_t *irk);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef BTHOME_HOST_ZEPHYR_KERNEL_H_
+#define BTHOME_HOST_ZEPHYR_KERNEL_H_
+
+//Host stand-in for the parts of the zephyr kernel the library uses.
+//Time is virtual and only moves in k_sleep (and BTHome::shim::run_for), which runs the work
+//items as they become due, on the calling thread. Everything is single threaded, so the
+//spinlocks are no-ops. See bthome_shim.hpp.
+#include <cstddef>
+#include <cstdint>
+#include <zephyr/sys/atomic.h>
+
+#define CONTAINER_OF(ptr, type, field) ((type *)(((char *)(ptr)) - offsetof(type, field)))
+
+struct k_timeout_t { int64_t us; };
+#define K_NO_WAIT (k_timeout_t{0})
+#define K_USEC(t) (k_timeout_t{int64_t(t)})
+#define K_MSEC(t) (k_timeout_t{int64_t(t) * 1000})
+
+struct k_work;
+typedef void (*k_work_handler_t)(struct k_work *work);
+
+struct k_work
+{
+    k_work_handler_t handler = nullptr;
+    int64_t due_us = 0;
+    uint64_t seq = 0;//FIFO among items due at the same time
+    bool queued = false;
+};
+
+struct k_work_delayable
+{
+    struct k_work work;
+};
+
+struct k_work_sync {};
+
+void k_work_init(struct k_work *work, k_work_handler_t handler);
+int k_work_submit(struct k_work *work);
+bool k_work_cancel_sync(struct k_work *work, struct k_work_sync *sync);
+
+void k_work_init_delayable(struct k_work_delayable *dwork, k_work_handler_t handler);
+int k_work_schedule(struct k_work_delayable *dwork, k_timeout_t delay);
+int k_work_reschedule(struct k_work_delayable *dwork, k_timeout_t delay);
+int k_work_cancel_delayable(struct k_work_delayable *dwork);
+bool k_work_cancel_delayable_sync(struct k_work_delayable *dwork, struct k_work_sync *sync);
+
+inline struct k_work_delayable *k_work_delayable_from_work(struct k_work *work)
+{
+    return CONTAINER_OF(work, struct k_work_delayable, work);
+}
+
+int32_t k_sleep(k_timeout_t timeout);
+int64_t k_uptime_get();
+inline uint32_t k_uptime_get_32() { return uint32_t(k_uptime_get()); }
+
+struct k_spinlock {};
+struct k_spinlock_key { int key; };
+typedef struct k_spinlock_key k_spinlock_key_t;
+
+inline k_spinlock_key_t k_spin_lock(struct k_spinlock *) { return {0}; }
+inline void k_spin_unlock(struct k_spinlock *, k_spinlock_key_t) {}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef BTHOME_HOST_ZEPHYR_SETTINGS_SETTINGS_H_
+#define BTHOME_HOST_ZEPHYR_SETTINGS_SETTINGS_H_
+
+#include <cstddef>
+#include <sys/types.h>
+
+//Host stand-in for zephyr/settings/settings.h: the subset the library uses, over an in-memory store
+//that survives shim::reset() like flash survives a reboot (see bthome_shim.hpp)
+typedef ssize_t (*settings_read_cb)(void *cb_arg, void *data, size_t len);
+typedef int (*settings_load_direct_cb)(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg, void *param);
+
+int settings_subsys_init(void);
+int settings_save_one(const char *name, const void *value, size_t val_len);
+int settings_delete(const char *name);
+//key is null for name == subtree, the rest of the name after "subtree/" otherwise
+int settings_load_subtree_direct(const char *subtree, settings_load_direct_cb cb, void *param);
+int settings_name_next(const char *name, const char **next);
+
+#endif
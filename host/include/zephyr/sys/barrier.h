@@ -0,0 +1,7 @@
+#ifndef BTHOME_HOST_ZEPHYR_SYS_BARRIER_H_
+#define BTHOME_HOST_ZEPHYR_SYS_BARRIER_H_
+
+//Host stand-in for zephyr/sys/barrier.h
+inline void barrier_dmem_fence_full() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+#endif
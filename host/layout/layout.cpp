@@ -0,0 +1,31 @@
+//Compile time of the consteval layout: an advertisement with BTHOME_LAYOUT_OBJECTS objects,
+//cycling through the numeric types (repeated types are told apart by update_nth).
+//Built by the bthome_layout_<N> targets, the compiler call is timed (see host/CMakeLists.txt).
+#include "bthome/bthome_comp.hpp"
+#include <tuple>
+
+using namespace BTHome;
+
+namespace
+{
+    using Pool = std::tuple<Temperature, Humidity, Pressure, Illuminance, Battery, CO2, TVOC, PM2_5,
+        PM10, VoltageFine, Current, Power, Energy, Count4, Dewpoint, MassKg>;
+    constexpr size_t kPool = std::tuple_size_v<Pool>;
+
+    template<size_t... I>
+    auto make(std::index_sequence<I...>) -> decltype(Advertisement("layout", Flags::None, std::tuple_element_t<I % kPool, Pool>{}...));
+
+    using Adv = decltype(make(std::make_index_sequence<BTHOME_LAYOUT_OBJECTS>{}));
+    static_assert(Adv::AdvLayout::kObjects == BTHOME_LAYOUT_OBJECTS);
+    static_assert(Adv::kPacksCount * Adv::kAllowedSensorPayload >= Adv::AdvLayout::kObjects * 2, "Layout lost objects");
+
+    Adv g_Adv("layout", Flags::None);
+}
+
+//the paths that depend on the layout: update lookups and the pack rotation
+int bthome_layout_entry(const bt_le_adv_param *pParam)
+{
+    g_Adv.update<Temperature>(21.5f);
+    g_Adv.update_nth<MassKg, (BTHOME_LAYOUT_OBJECTS - 1) / kPool>(1.5f);
+    return g_Adv.advertise_with(pParam, 100) + int(Adv::kPacksCount);
+}
@@ -0,0 +1,27 @@
+#compiler launcher: runs the command given after -- and prints its wall time in ms
+#(cmake -E time only has whole seconds, %f needs CMake 3.23)
+#the -- keeps cmake from parsing the compiler flags (-DNDEBUG) as its own options
+set(cmd)
+set(found OFF)
+math(EXPR last "${CMAKE_ARGC} - 1")
+foreach(i RANGE 1 ${last})
+    if(found)
+        list(APPEND cmd "${CMAKE_ARGV${i}}")
+    elseif(CMAKE_ARGV${i} STREQUAL "--")
+        set(found ON)
+    endif()
+endforeach()
+
+string(TIMESTAMP t0 "%s%f" UTC)
+execute_process(COMMAND ${cmd} RESULT_VARIABLE res)
+string(TIMESTAMP t1 "%s%f" UTC)
+math(EXPR ms "(${t1} - ${t0}) / 1000")
+foreach(arg IN LISTS cmd)
+    if(arg MATCHES "BTHOME_LAYOUT_OBJECTS=([0-9]+)")
+        set(what "${CMAKE_MATCH_1} objects")
+    endif()
+endforeach()
+message("layout ${what}: ${ms} ms")
+if(NOT res EQUAL 0)
+    message(FATAL_ERROR "compilation failed")
+endif()
@@ -0,0 +1,512 @@
+#include "bthome_shim.hpp"
+#include <zephyr/settings/settings.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <string>
+
+struct bt_le_ext_adv
+{
+    bool m_Used = false;
+    bool m_Running = false;
+    bool m_PerConfigured = false;
+    bool m_PerRunning = false;
+    int64_t m_StartUs = 0;
+};
+
+namespace BTHome::shim
+{
+    namespace
+    {
+        struct State
+        {
+            int64_t m_NowUs = 0;
+            uint64_t m_Seq = 0;
+            std::vector<k_work*> m_Queue;
+            bool m_InWork = false;
+
+            std::vector<Frame> m_Frames;
+            size_t m_Counts[size_t(Call::Count)] = {};
+            bool m_Record = true;
+            int m_FailErr[size_t(Call::Count)] = {};
+            unsigned m_FailTimes[size_t(Call::Count)] = {};
+
+            bool m_Legacy = false;
+            int64_t m_LegacyStartUs = 0;
+            int64_t m_OnAirUs = 0;
+            bt_le_ext_adv m_Sets[CONFIG_BT_EXT_ADV_MAX_ADV_SET];
+            int m_Ids = 1;
+        };
+
+        State g_State;
+
+        //not part of State: reset() is a reboot, the flash keeps its content
+        struct Settings
+        {
+            std::map<std::string, std::vector<uint8_t>> m_Values;
+            size_t m_Writes = 0;
+        };
+
+        Settings g_Settings;
+
+        void enqueue(k_work *pWork, int64_t dueUs)
+        {
+            pWork->due_us = dueUs;
+            pWork->seq = g_State.m_Seq++;
+            if (!pWork->queued)
+                g_State.m_Queue.push_back(pWork);
+            pWork->queued = true;
+        }
+
+        bool dequeue(k_work *pWork)
+        {
+            if (!pWork->queued)
+                return false;
+            auto &q = g_State.m_Queue;
+            q.erase(std::find(q.begin(), q.end(), pWork));
+            pWork->queued = false;
+            return true;
+        }
+
+        //runs the earliest item due by untilUs, advancing the clock to it
+        bool run_next(int64_t untilUs)
+        {
+            auto &q = g_State.m_Queue;
+            auto it = std::min_element(q.begin(), q.end(), [](const k_work *a, const k_work *b){
+                return a->due_us != b->due_us ? a->due_us < b->due_us : a->seq < b->seq;
+            });
+            if (it == q.end() || (*it)->due_us > untilUs)
+                return false;
+            k_work *pWork = *it;
+            q.erase(it);
+            pWork->queued = false;
+            g_State.m_NowUs = std::max(g_State.m_NowUs, pWork->due_us);
+            g_State.m_InWork = true;
+            pWork->handler(pWork);
+            g_State.m_InWork = false;
+            return true;
+        }
+
+        //returns the injected error, if any, for a call of kind c
+        int failure(Call c)
+        {
+            unsigned &times = g_State.m_FailTimes[size_t(c)];
+            if (!times)
+                return 0;
+            --times;
+            return g_State.m_FailErr[size_t(c)];
+        }
+
+        void serialize(std::vector<uint8_t> &dst, const bt_data *pData, size_t len)
+        {
+            for(size_t i = 0; i < len; ++i)
+            {
+                dst.push_back(uint8_t(pData[i].data_len + 1));
+                dst.push_back(pData[i].type);
+                dst.insert(dst.end(), pData[i].data, pData[i].data + pData[i].data_len);
+            }
+        }
+
+        void record(Call c, const bt_le_ext_adv *pSet, const bt_le_adv_param *pParam = nullptr,
+                    const bt_data *ad = nullptr, size_t ad_len = 0, const bt_data *sd = nullptr, size_t sd_len = 0)
+        {
+            ++g_State.m_Counts[size_t(c)];
+            if (!g_State.m_Record)
+                return;
+            Frame f{g_State.m_NowUs, c, pSet, pParam ? *pParam : bt_le_adv_param{}, {}, {}};
+            serialize(f.m_Adv, ad, ad_len);
+            serialize(f.m_Scan, sd, sd_len);
+            g_State.m_Frames.push_back(std::move(f));
+        }
+
+        size_t adv_size(const bt_data *ad, size_t ad_len)
+        {
+            size_t size = 0;
+            for(size_t i = 0; i < ad_len; ++i)
+                size += 2 + ad[i].data_len;
+            return size;
+        }
+
+#if defined(CONFIG_BT_CTLR_ADV_DATA_LEN_MAX)
+        constexpr size_t kExtDataMax = CONFIG_BT_CTLR_ADV_DATA_LEN_MAX;
+#else
+        constexpr size_t kExtDataMax = 31;
+#endif
+
+        bool valid_set(const bt_le_ext_adv *pSet)
+        {
+            return pSet && pSet >= g_State.m_Sets && pSet < g_State.m_Sets + CONFIG_BT_EXT_ADV_MAX_ADV_SET && pSet->m_Used;
+        }
+    }
+
+    std::vector<uint8_t> Frame::service_data() const
+    {
+        for(size_t i = 0; i + 1 < m_Adv.size(); i += 1 + m_Adv[i])
+        {
+            if (m_Adv[i + 1] == BT_DATA_SVC_DATA16)
+                return {m_Adv.begin() + i + 2, m_Adv.begin() + i + 1 + m_Adv[i]};
+        }
+        return {};
+    }
+
+    void reset()
+    {
+        for(k_work *pWork : g_State.m_Queue)
+            pWork->queued = false;
+        //sets stay created: advertisements keep their pointers across a reset
+        bool used[CONFIG_BT_EXT_ADV_MAX_ADV_SET];
+        for(size_t i = 0; i < CONFIG_BT_EXT_ADV_MAX_ADV_SET; ++i)
+            used[i] = g_State.m_Sets[i].m_Used;
+        g_State = State{};
+        for(size_t i = 0; i < CONFIG_BT_EXT_ADV_MAX_ADV_SET; ++i)
+            g_State.m_Sets[i].m_Used = used[i];
+    }
+
+    int64_t now_us() { return g_State.m_NowUs; }
+
+    void run_for(int64_t ms)
+    {
+        const int64_t untilUs = g_State.m_NowUs + ms * 1000;
+        while(run_next(untilUs));
+        g_State.m_NowUs = untilUs;
+    }
+
+    bool run_until_idle(int64_t max_ms)
+    {
+        const int64_t untilUs = g_State.m_NowUs + max_ms * 1000;
+        while(run_next(untilUs));
+        if (!g_State.m_Queue.empty())
+            g_State.m_NowUs = std::max(g_State.m_NowUs, untilUs);
+        return g_State.m_Queue.empty();
+    }
+
+    size_t queued_work() { return g_State.m_Queue.size(); }
+
+    const std::vector<Frame>& frames() { return g_State.m_Frames; }
+    size_t count(Call c) { return g_State.m_Counts[size_t(c)]; }
+    void record_frames(bool on) { g_State.m_Record = on; }
+
+    void fail_next(Call c, int err, unsigned times)
+    {
+        g_State.m_FailErr[size_t(c)] = err;
+        g_State.m_FailTimes[size_t(c)] = times;
+    }
+
+    int64_t on_air_us()
+    {
+        int64_t us = g_State.m_OnAirUs;
+        if (g_State.m_Legacy)
+            us += g_State.m_NowUs - g_State.m_LegacyStartUs;
+        for(const auto &s : g_State.m_Sets)
+            if (s.m_Running)
+                us += g_State.m_NowUs - s.m_StartUs;
+        return us;
+    }
+
+    bool legacy_advertising() { return g_State.m_Legacy; }
+
+    void clear_settings() { g_Settings = Settings{}; }
+    size_t settings_writes() { return g_Settings.m_Writes; }
+}
+
+using namespace BTHome::shim;
+
+void k_work_init(k_work *work, k_work_handler_t handler)
+{
+    *work = k_work{};
+    work->handler = handler;
+}
+
+int k_work_submit(k_work *work)
+{
+    if (work->queued)
+        return 0;
+    enqueue(work, g_State.m_NowUs);
+    return 1;
+}
+
+bool k_work_cancel_sync(k_work *work, k_work_sync *)
+{
+    return dequeue(work);
+}
+
+void k_work_init_delayable(k_work_delayable *dwork, k_work_handler_t handler)
+{
+    k_work_init(&dwork->work, handler);
+}
+
+int k_work_schedule(k_work_delayable *dwork, k_timeout_t delay)
+{
+    if (dwork->work.queued)
+        return 0;
+    enqueue(&dwork->work, g_State.m_NowUs + delay.us);
+    return 1;
+}
+
+int k_work_reschedule(k_work_delayable *dwork, k_timeout_t delay)
+{
+    enqueue(&dwork->work, g_State.m_NowUs + delay.us);
+    return 1;
+}
+
+int k_work_cancel_delayable(k_work_delayable *dwork)
+{
+    dequeue(&dwork->work);
+    return 0;
+}
+
+bool k_work_cancel_delayable_sync(k_work_delayable *dwork, k_work_sync *)
+{
+    return dequeue(&dwork->work);
+}
+
+int32_t k_sleep(k_timeout_t timeout)
+{
+    //a work item sleeping blocks the queue, only the time passes
+    if (g_State.m_InWork)
+        g_State.m_NowUs += timeout.us;
+    else
+        run_for(timeout.us / 1000);
+    return 0;
+}
+
+int64_t k_uptime_get() { return g_State.m_NowUs / 1000; }
+
+int bt_le_adv_start(const bt_le_adv_param *param, const bt_data *ad, size_t ad_len, const bt_data *sd, size_t sd_len)
+{
+    if (int err = failure(Call::AdvStart))
+        return err;
+    if (g_State.m_Legacy)
+        return -EALREADY;
+    if (adv_size(ad, ad_len) > 31 || adv_size(sd, sd_len) > 31)
+        return -EINVAL;
+    g_State.m_Legacy = true;
+    g_State.m_LegacyStartUs = g_State.m_NowUs;
+    record(Call::AdvStart, nullptr, param, ad, ad_len, sd, sd_len);
+    return 0;
+}
+
+int bt_le_adv_update_data(const bt_data *ad, size_t ad_len, const bt_data *sd, size_t sd_len)
+{
+    if (int err = failure(Call::AdvUpdate))
+        return err;
+    if (!g_State.m_Legacy)
+        return -EAGAIN;
+    if (adv_size(ad, ad_len) > 31 || adv_size(sd, sd_len) > 31)
+        return -EINVAL;
+    record(Call::AdvUpdate, nullptr, nullptr, ad, ad_len, sd, sd_len);
+    return 0;
+}
+
+int bt_le_adv_stop()
+{
+    if (int err = failure(Call::AdvStop))
+        return err;
+    //like zephyr, stopping a stopped advertiser is fine
+    if (g_State.m_Legacy)
+    {
+        g_State.m_OnAirUs += g_State.m_NowUs - g_State.m_LegacyStartUs;
+        g_State.m_Legacy = false;
+        record(Call::AdvStop, nullptr);
+    }
+    return 0;
+}
+
+int bt_le_ext_adv_create(const bt_le_adv_param *param, const bt_le_ext_adv_cb *, bt_le_ext_adv **adv)
+{
+    if (int err = failure(Call::ExtCreate))
+        return err;
+    for(auto &s : g_State.m_Sets)
+    {
+        if (s.m_Used)
+            continue;
+        s = bt_le_ext_adv{};
+        s.m_Used = true;
+        *adv = &s;
+        record(Call::ExtCreate, &s, param);
+        return 0;
+    }
+    return -ENOMEM;
+}
+
+int bt_le_ext_adv_update_param(bt_le_ext_adv *adv, const bt_le_adv_param *param)
+{
+    if (int err = failure(Call::ExtUpdateParam))
+        return err;
+    if (!valid_set(adv))
+        return -EINVAL;
+    if (adv->m_Running)
+        return -EINVAL;
+    record(Call::ExtUpdateParam, adv, param);
+    return 0;
+}
+
+int bt_le_ext_adv_set_data(bt_le_ext_adv *adv, const bt_data *ad, size_t ad_len, const bt_data *sd, size_t sd_len)
+{
+    if (int err = failure(Call::ExtSetData))
+        return err;
+    if (!valid_set(adv))
+        return -EINVAL;
+    if (adv_size(ad, ad_len) > kExtDataMax || adv_size(sd, sd_len) > kExtDataMax)
+        return -EINVAL;
+    record(Call::ExtSetData, adv, nullptr, ad, ad_len, sd, sd_len);
+    return 0;
+}
+
+int bt_le_ext_adv_start(bt_le_ext_adv *adv, const bt_le_ext_adv_start_param *)
+{
+    if (int err = failure(Call::ExtStart))
+        return err;
+    if (!valid_set(adv))
+        return -EINVAL;
+    if (adv->m_Running)
+        return -EALREADY;
+    adv->m_Running = true;
+    adv->m_StartUs = g_State.m_NowUs;
+    record(Call::ExtStart, adv);
+    return 0;
+}
+
+int bt_le_ext_adv_stop(bt_le_ext_adv *adv)
+{
+    if (int err = failure(Call::ExtStop))
+        return err;
+    if (!valid_set(adv))
+        return -EINVAL;
+    if (adv->m_Running)
+    {
+        g_State.m_OnAirUs += g_State.m_NowUs - adv->m_StartUs;
+        adv->m_Running = false;
+        record(Call::ExtStop, adv);
+    }
+    return 0;
+}
+
+int bt_le_ext_adv_delete(bt_le_ext_adv *adv)
+{
+    if (int err = failure(Call::ExtDelete))
+        return err;
+    if (!valid_set(adv))
+        return -EINVAL;
+    if (adv->m_Running)
+        g_State.m_OnAirUs += g_State.m_NowUs - adv->m_StartUs;
+    *adv = bt_le_ext_adv{};
+    record(Call::ExtDelete, adv);
+    return 0;
+}
+
+int bt_le_per_adv_set_param(bt_le_ext_adv *adv, const bt_le_per_adv_param *)
+{
+    if (int err = failure(Call::PerSetParam))
+        return err;
+    if (!valid_set(adv))
+        return -EINVAL;
+    adv->m_PerConfigured = true;
+    record(Call::PerSetParam, adv);
+    return 0;
+}
+
+int bt_le_per_adv_set_data(const bt_le_ext_adv *adv, const bt_data *ad, size_t ad_len)
+{
+    if (int err = failure(Call::PerSetData))
+        return err;
+    if (!valid_set(adv) || !adv->m_PerConfigured)
+        return -EINVAL;
+    if (adv_size(ad, ad_len) > kExtDataMax)
+        return -EINVAL;
+    record(Call::PerSetData, adv, nullptr, ad, ad_len);
+    return 0;
+}
+
+int bt_le_per_adv_start(bt_le_ext_adv *adv)
+{
+    if (int err = failure(Call::PerStart))
+        return err;
+    if (!valid_set(adv) || !adv->m_PerConfigured)
+        return -EINVAL;
+    if (adv->m_PerRunning)
+        return -EALREADY;
+    adv->m_PerRunning = true;
+    record(Call::PerStart, adv);
+    return 0;
+}
+
+int bt_le_per_adv_stop(bt_le_ext_adv *adv)
+{
+    if (int err = failure(Call::PerStop))
+        return err;
+    if (!valid_set(adv))
+        return -EINVAL;
+    adv->m_PerRunning = false;
+    record(Call::PerStop, adv);
+    return 0;
+}
+
+int bt_id_create(bt_addr_le_t *, uint8_t *)
+{
+    if (g_State.m_Ids >= CONFIG_BT_ID_MAX)
+        return -ENOMEM;
+    return g_State.m_Ids++;
+}
+
+int settings_subsys_init(void) { return 0; }
+
+int settings_save_one(const char *name, const void *value, size_t val_len)
+{
+    const uint8_t *p = static_cast<const uint8_t*>(value);
+    g_Settings.m_Values[name].assign(p, p + val_len);
+    ++g_Settings.m_Writes;
+    return 0;
+}
+
+int settings_delete(const char *name)
+{
+    g_Settings.m_Values.erase(name);
+    return 0;
+}
+
+int settings_load_subtree_direct(const char *subtree, settings_load_direct_cb cb, void *param)
+{
+    struct Reader
+    {
+        const std::vector<uint8_t> *m_pValue;
+        static ssize_t read(void *cb_arg, void *data, size_t len)
+        {
+            const auto &v = *static_cast<Reader*>(cb_arg)->m_pValue;
+            const size_t n = std::min(len, v.size());
+            std::memcpy(data, v.data(), n);
+            return ssize_t(n);
+        }
+    };
+
+    const size_t prefix = std::strlen(subtree);
+    for(const auto &[name, value] : g_Settings.m_Values)
+    {
+        const char *key;
+        if (name == subtree)
+            key = nullptr;
+        else if (name.compare(0, prefix, subtree) == 0 && name.size() > prefix && name[prefix] == '/')
+            key = name.c_str() + prefix + 1;
+        else
+            continue;
+        Reader r{&value};
+        if (int err = cb(key, value.size(), &Reader::read, &r, param))
+            return err;
+    }
+    return 0;
+}
+
+int settings_name_next(const char *name, const char **next)
+{
+    if (next)
+        *next = nullptr;
+    if (!name)
+        return 0;
+    int len = 0;
+    while(name[len] && name[len] != '/' && name[len] != '=')
+        ++len;
+    if (name[len] == '/' && next)
+        *next = name + len + 1;
+    return len;
+}
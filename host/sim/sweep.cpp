@@ -0,0 +1,131 @@
+//Sweep of bthome_sim.hpp over advertising interval, pack slot, scan window and number of
+//advertisers, CSV on stdout. The advertisers carry the packs of a ten-object Advertisement.
+//Latency percentiles that are timeouts are left empty.
+//--quick: a small grid over a short run with sanity checks, for ctest.
+#include "bthome/bthome_comp.hpp"
+#include "bthome/bthome_sim.hpp"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+using namespace BTHome;
+
+namespace
+{
+    using Adv = decltype(Advertisement("sweep", Flags::None, Temperature{}, Humidity{}, Pressure{}, Illuminance{}, Battery{},
+        CO2{}, TVOC{}, PM2_5{}, PM10{}, VoltageFine{}));
+
+    constexpr size_t kMaxAdvertisers = 64;
+    constexpr uint32_t kScanInterval = 0x60;
+
+    struct Grid
+    {
+        const size_t *m_pAdvertisers; size_t m_AdvertisersCount;
+        const uint32_t *m_pIntervals; size_t m_IntervalsCount;//0.625 ms units
+        const uint32_t *m_pSlotsMs; size_t m_SlotsCount;
+        const uint32_t *m_pWindowsPct; size_t m_WindowsCount;//of the scan interval
+        uint32_t m_DurationMs;
+    };
+
+    struct Point
+    {
+        float m_Reception;
+        float m_SlotReception;
+        float m_MeanMs;
+        uint32_t m_P50Ms;
+        uint32_t m_P95Ms;
+        uint32_t m_Timeouts;
+    };
+
+    //the first advertiser's numbers, the others are there to collide with it
+    Point simulate(size_t advertisers, uint32_t interval, uint32_t slot_ms, uint32_t window_pct, uint32_t duration_ms)
+    {
+        sim::SimConfig cfg;
+        cfg.m_ScanInterval = kScanInterval;
+        cfg.m_ScanWindow = kScanInterval * window_pct / 100;
+        auto pSim = std::make_unique<sim::ReceptionSim<kMaxAdvertisers>>(cfg);
+        for(size_t i = 0; i < advertisers; ++i)
+            pSim->add(sim::MakeAdvertiser<Adv>(interval, slot_ms));
+        pSim->run(duration_ms);
+
+        Point p{};
+        for(size_t k = 0; k < Adv::kPacksCount; ++k)
+        {
+            p.m_Reception += pSim->pack(0, k).reception() / float(Adv::kPacksCount);
+            p.m_SlotReception += pSim->pack(0, k).slot_reception() / float(Adv::kPacksCount);
+        }
+        const sim::LatencyStats &l = pSim->latency(0);
+        p.m_MeanMs = l.mean_ms();
+        p.m_P50Ms = l.percentile_ms(0.5f);
+        p.m_P95Ms = l.percentile_ms(0.95f);
+        p.m_Timeouts = l.m_Timeouts;
+        return p;
+    }
+
+    //empty field for a percentile that is a timeout
+    const char* ms_field(uint32_t ms, char (&buf)[16])
+    {
+        if (ms == UINT32_MAX)
+            buf[0] = 0;
+        else
+            std::snprintf(buf, sizeof(buf), "%u", ms);
+        return buf;
+    }
+
+    int g_Failures = 0;
+    void expect(bool ok, const char *what)
+    {
+        if (ok)
+            return;
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++g_Failures;
+    }
+
+    void sweep(const Grid &g, bool check)
+    {
+        std::printf("advertisers,interval_ms,slot_ms,scan_window_pct,reception,slot_reception,latency_mean_ms,latency_p50_ms,latency_p95_ms,timeouts\n");
+        for(size_t ai = 0; ai < g.m_AdvertisersCount; ++ai)
+            for(size_t ii = 0; ii < g.m_IntervalsCount; ++ii)
+                for(size_t si = 0; si < g.m_SlotsCount; ++si)
+                    for(size_t wi = 0; wi < g.m_WindowsCount; ++wi)
+                    {
+                        const size_t n = g.m_pAdvertisers[ai];
+                        const uint32_t interval = g.m_pIntervals[ii], slot = g.m_pSlotsMs[si], window = g.m_pWindowsPct[wi];
+                        const Point p = simulate(n, interval, slot, window, g.m_DurationMs);
+                        char p50[16], p95[16];
+                        std::printf("%zu,%.1f,%u,%u,%.4f,%.4f,%.1f,%s,%s,%u\n", n, interval * 0.625, slot, window,
+                            p.m_Reception, p.m_SlotReception, p.m_MeanMs, ms_field(p.m_P50Ms, p50), ms_field(p.m_P95Ms, p95), p.m_Timeouts);
+
+                        if (!check)
+                            continue;
+                        expect(p.m_Reception >= 0.f && p.m_Reception <= 1.f && p.m_SlotReception <= 1.f, "ratios within 0..1");
+                        if (n == 1 && window == 100)
+                        {
+                            expect(p.m_SlotReception > 0.99f, "a lone advertiser under continuous scanning gets every slot through");
+                            expect(p.m_Timeouts == 0, "a lone advertiser under continuous scanning has no timeouts");
+                        }
+                    }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const bool quick = argc > 1 && !std::strcmp(argv[1], "--quick");
+    if (quick)
+    {
+        static const size_t advertisers[] = {1, 20};
+        static const uint32_t intervals[] = {0x30, 0xa0};
+        static const uint32_t slots[] = {1000};
+        static const uint32_t windows[] = {100, 30};
+        sweep({advertisers, 2, intervals, 2, slots, 1, windows, 2, 20 * 1000}, true);
+    }
+    else
+    {
+        static const size_t advertisers[] = {1, 5, 20, 50};
+        static const uint32_t intervals[] = {0x30, 0xa0, 0x320};
+        static const uint32_t slots[] = {500, 1000, 2000};
+        static const uint32_t windows[] = {100, 50, 10};
+        sweep({advertisers, 4, intervals, 3, slots, 3, windows, 3, 120 * 1000}, false);
+    }
+    return g_Failures ? 1 : 0;
+}
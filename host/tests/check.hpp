@@ -0,0 +1,29 @@
+#ifndef BTHOME_CHECK_HPP_
+#define BTHOME_CHECK_HPP_
+
+#include <cstdio>
+
+//Minimal checks for the host tests: failures are printed and counted, main returns test::result()
+namespace BTHome::test
+{
+    inline int g_Failures = 0;
+
+    inline void check(bool ok, const char *what, const char *file, int line)
+    {
+        if (ok)
+            return;
+        std::printf("%s:%d: FAILED: %s\n", file, line, what);
+        ++g_Failures;
+    }
+
+    inline int result()
+    {
+        if (g_Failures)
+            std::printf("%d check(s) failed\n", g_Failures);
+        return g_Failures ? 1 : 0;
+    }
+}
+
+#define BTHOME_CHECK(x) ::BTHome::test::check((x), #x, __FILE__, __LINE__)
+
+#endif
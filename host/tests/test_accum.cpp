@@ -0,0 +1,131 @@
+//Accumulator over IntData (Count4) and FloatData (Energy) objects: pulses and rates reach the
+//advertised value, the total is persisted through settings and restored after a reboot
+#include "bthome/bthome_accum.hpp"
+#include "bthome/bthome_decoder.hpp"
+#include "bthome_shim.hpp"
+#include "check.hpp"
+#include <cerrno>
+
+using namespace BTHome;
+
+namespace
+{
+    using Adv = decltype(Advertisement("test", Flags::None, Energy{}, Count4{}, Temperature{}));
+
+    //wire values as is, for IntData too
+    constexpr Count4 kRaw(RawValue{0x01020304});
+    static_assert(kRaw.m_Data[1] == 0x04 && kRaw.m_Data[4] == 0x01);
+
+    template<class X>
+    int64_t advertised(Adv &adv)
+    {
+        constexpr size_t kIdx = Adv::template kIndexOf<X, 0>;
+        return decoder::ReadRaw(adv.template encoded_value<kIdx>(), decoder::InfoOf<X>());
+    }
+
+    void pulses()
+    {
+        shim::reset();
+        Adv adv("test", Flags::None);
+        Accumulator<Adv, Count4> count(adv);
+        count.add_pulses(3);
+        count.add_pulses(4);
+        BTHOME_CHECK(count.publish());
+        BTHOME_CHECK(advertised<Count4>(adv) == 7);
+
+        //2000 imp/kWh: half a Wh per pulse
+        Accumulator<Adv, Energy> energy(adv);
+        energy.set_pulse_weight(energy.kOne / 2);
+        energy.add_pulses(5);
+        energy.publish();
+        BTHOME_CHECK(advertised<Energy>(adv) == 2);
+        energy.add_pulses(1);
+        energy.publish();
+        BTHOME_CHECK(advertised<Energy>(adv) == 3);
+    }
+
+    //1 kW sampled every ms for an hour is 1000 Wh, however the samples are cut
+    void rate()
+    {
+        shim::reset();
+        Adv adv("test", Flags::None);
+        Accumulator<Adv, Energy> energy(adv);
+        for(int i = 0; i < 3600 * 1000; ++i)
+            energy.add_rate(1000, 1);
+        BTHOME_CHECK(energy.total_fixed() == 1000 * energy.kOne);
+        energy.publish();
+        BTHOME_CHECK(advertised<Energy>(adv) == 1000);
+
+        //uneven samples, a consumer and a producer
+        Accumulator<Adv, Energy> mixed(adv);
+        for(int i = 0; i < 1000; ++i)
+        {
+            mixed.add_rate(1237, 7);
+            mixed.add_rate(-1237, 3);
+        }
+        //within the 1/65536 resolution of the exact total, the rest is carried
+        const int64_t exact = 1237 * 4000 * mixed.kOne / (3600 * 1000);
+        BTHOME_CHECK(mixed.total_fixed() >= exact - 1 && mixed.total_fixed() <= exact + 1);
+    }
+
+    //the advertised total wraps at the wire width
+    void wraps()
+    {
+        shim::reset();
+        Adv adv("test", Flags::None);
+        Accumulator<Adv, Count4> count(adv);
+        count.set_total_fixed((int64_t(0xffffffff) << Accumulator<Adv, Count4>::kFracBits));
+        count.add_pulses(2);
+        count.publish();
+        BTHOME_CHECK(advertised<Count4>(adv) == 1);
+    }
+
+    void persisted()
+    {
+        shim::reset();
+        shim::clear_settings();
+        {
+            Adv adv("test", Flags::None);
+            Accumulator<Adv, Count4> count(adv, {"bthome/count", 1000, 1});
+            BTHOME_CHECK(count.restore() == 0);//nothing saved yet
+            BTHOME_CHECK(shim::settings_writes() == 0);
+            count.add_pulses(41);
+            //writes are batched: none before the interval
+            shim::run_for(999);
+            BTHOME_CHECK(shim::settings_writes() == 0);
+            shim::run_for(1);
+            BTHOME_CHECK(shim::settings_writes() == 1);
+            count.add_pulses(1);
+            BTHOME_CHECK(count.flush() == 0);
+            BTHOME_CHECK(shim::settings_writes() == 2);
+        }
+
+        shim::reset();
+        Adv adv("test", Flags::None);
+        Accumulator<Adv, Count4> count(adv, {"bthome/count", 1000, 1});
+        count.add_pulses(1);//before the restore, kept
+        //the checkpoint waits for the restore, it would write 1 over the saved 42
+        shim::run_for(5000);
+        BTHOME_CHECK(shim::settings_writes() == 2);
+        BTHOME_CHECK(count.flush() == -EAGAIN);
+        BTHOME_CHECK(count.restore() == 0);
+        BTHOME_CHECK(advertised<Count4>(adv) == 43);
+        shim::run_for(1);
+        BTHOME_CHECK(shim::settings_writes() == 3);
+
+        shim::reset();
+        Adv again("test", Flags::None);
+        Accumulator<Adv, Count4> next(again, {"bthome/count", 1000, 1});
+        BTHOME_CHECK(next.restore() == 0);
+        BTHOME_CHECK(advertised<Count4>(again) == 43);
+    }
+}
+
+int main()
+{
+    pulses();
+    rate();
+    wraps();
+    persisted();
+    return test::result();
+}
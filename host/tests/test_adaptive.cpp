@@ -0,0 +1,70 @@
+//AdaptiveScheduler: the pause doubles while readings are stable, a significant change starts a cycle
+//right away, and a cycle that finds the advertiser busy is retried instead of never running again
+#include "bthome/bthome_adaptive.hpp"
+#include "bthome_shim.hpp"
+#include "check.hpp"
+
+using namespace BTHome;
+using shim::Call;
+
+namespace
+{
+    //one pack
+    using Adv = BasicAdvertisement<AdvOptions, sizeof("test"), Temperature, Humidity>;
+    static_assert(Adv::kPacksCount == 1);
+
+    const bt_le_adv_param kParam = BT_LE_ADV_PARAM_INIT(AdvOptions::kDefaultAdvOpt, BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, nullptr);
+    constexpr AdaptiveConfig kConfig{.m_PackDurationMs = 100, .m_FastPauseMs = 1000, .m_SlowPauseMs = 8000};
+
+    Adv g_Adv("test", Flags::None);
+
+    void pause_adapts()
+    {
+        shim::reset();
+        static AdaptiveScheduler<Adv> sched(g_Adv, kConfig);
+        sched.start();
+        //no change in the first cycle already doubles the pause: cycles at 0, 2100, 6200, 14300 and 22400
+        shim::run_for(24000);
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 5);
+        BTHOME_CHECK(sched.cycle_pause_ms() == kConfig.m_SlowPauseMs);
+
+        //below the deadband: no cycle
+        BTHOME_CHECK(!sched.update<Temperature>(Scaled{5}));
+        BTHOME_CHECK(shim::queued_work() == 1);
+        shim::run_for(10);
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 5);
+
+        BTHOME_CHECK(sched.update<Temperature>(21.5f));
+        shim::run_for(10);
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 6);
+        shim::run_for(200);
+        BTHOME_CHECK(sched.cycle_pause_ms() == kConfig.m_FastPauseMs);
+        sched.stop();
+    }
+
+    //the advertiser is taken by another async cycle when the scheduler's turn comes
+    void busy_advertiser()
+    {
+        shim::reset();
+        static AdaptiveScheduler<Adv> sched(g_Adv, kConfig);
+        g_Adv.advertise_with_async(&kParam, 2500);
+        sched.start();
+        shim::run_for(100);
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 1);
+        BTHOME_CHECK(shim::queued_work() > 0);
+
+        //retried every kFastPauseMs until the other cycle is done
+        shim::run_for(3000);
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 2);
+        shim::run_for(10000);
+        BTHOME_CHECK(shim::count(Call::AdvStart) > 2);
+        sched.stop();
+    }
+}
+
+int main()
+{
+    pause_adapts();
+    busy_advertiser();
+    return test::result();
+}
@@ -0,0 +1,198 @@
+//AES-CCM against the published vectors: the AES block (FIPS-197), then the BTHome v2
+//encryption example step by step (nonce, ciphertext, MIC) and as a whole advertisement
+//sent through the shim. The frames are decrypted back with a separate CCM decoder.
+#include "bthome/bthome_comp.hpp"
+#include "bthome_shim.hpp"
+#include "check.hpp"
+#include <cstring>
+
+using namespace BTHome;
+using shim::Call;
+
+namespace
+{
+    //BTHome v2 specification, encryption example
+    constexpr uint8_t kKey[16] = {0x23, 0x1d, 0x39, 0xc1, 0xd7, 0xcc, 0x1a, 0xb1, 0xae, 0xe2, 0x24, 0xcd, 0x09, 0x6d, 0xb9, 0x32};
+    constexpr uint8_t kMac[6] = {0x54, 0x48, 0xe6, 0x8f, 0x80, 0xa5};
+    constexpr uint32_t kCounter = 0x33221100;//00 11 22 33 on air
+    constexpr uint8_t kPlain[] = {0xd2, 0xfc, 0x41, 0x02, 0xca, 0x09, 0x03, 0xbf, 0x13};
+    constexpr uint8_t kNonce[13] = {0x54, 0x48, 0xe6, 0x8f, 0x80, 0xa5, 0xd2, 0xfc, 0x41, 0x00, 0x11, 0x22, 0x33};
+    constexpr uint8_t kCipherText[] = {0xa4, 0x72, 0x66, 0xc9, 0x5f, 0x73};
+    constexpr uint8_t kMic[4] = {0x78, 0x23, 0x72, 0x14};
+    constexpr uint8_t kFrame[] = {0xd2, 0xfc, 0x41, 0xa4, 0x72, 0x66, 0xc9, 0x5f, 0x73, 0x00, 0x11, 0x22, 0x33, 0x78, 0x23, 0x72, 0x14};
+
+    const bt_le_adv_param kParam = BT_LE_ADV_PARAM_INIT(AdvOptions::kDefaultAdvOpt, BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, nullptr);
+    const bt_le_adv_param kExtParam = BT_LE_ADV_PARAM_INIT(ExtAdvOptions::kDefaultAdvOpt, BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, nullptr);
+
+    //receiver side: counter and MIC are taken from the frame, returns false if the MIC doesn't match
+    bool decrypt(const std::vector<uint8_t> &frame, const uint8_t (&mac)[6], std::vector<uint8_t> &plain)
+    {
+        const tools::Aes128 aes(kKey);
+        const size_t len = frame.size() - tools::Cipher::kOverhead - tools::Cipher::kHeaderSize;
+        const uint8_t *pIn = frame.data() + tools::Cipher::kHeaderSize;
+        const uint8_t *pCounter = pIn + len;
+        const uint8_t *pMic = pCounter + tools::Cipher::kCounterSize;
+
+        uint8_t nonce[13];
+        std::memcpy(nonce, mac, 6);
+        std::memcpy(nonce + 6, frame.data(), 3);
+        std::memcpy(nonce + 9, pCounter, 4);
+
+        uint8_t a[16] = {0x01};//L = 2
+        std::memcpy(a + 1, nonce, 13);
+        uint8_t s[16];
+        plain.assign(frame.begin(), frame.begin() + tools::Cipher::kHeaderSize);
+        for(size_t off = 0; off < len; off += 16)
+        {
+            a[15] = uint8_t(off / 16 + 1);
+            aes.encrypt_block(a, s);
+            for(size_t i = 0; i < 16 && off + i < len; ++i)
+                plain.push_back(pIn[off + i] ^ s[i]);
+        }
+
+        uint8_t x[16] = {0x09};//M = 4, L = 2
+        std::memcpy(x + 1, nonce, 13);
+        x[15] = uint8_t(len);
+        aes.encrypt_block(x, x);
+        for(size_t off = 0; off < len; off += 16)
+        {
+            for(size_t i = 0; i < 16 && off + i < len; ++i)
+                x[i] ^= plain[tools::Cipher::kHeaderSize + off + i];
+            aes.encrypt_block(x, x);
+        }
+        a[15] = 0;
+        aes.encrypt_block(a, s);
+        for(size_t i = 0; i < 4; ++i)
+            if ((x[i] ^ s[i]) != pMic[i])
+                return false;
+        return true;
+    }
+
+    std::vector<uint8_t> last_service_data()
+    {
+        for(auto i = shim::frames().rbegin(); i != shim::frames().rend(); ++i)
+            if (i->has_data())
+                return i->service_data();
+        return {};
+    }
+
+    void aes_block()
+    {
+        //FIPS-197 appendix C.1
+        constexpr uint8_t key[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+        constexpr uint8_t in[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+        constexpr uint8_t out[16] = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+        uint8_t res[16];
+        tools::Aes128(key).encrypt_block(in, res);
+        BTHOME_CHECK(std::memcmp(res, out, 16) == 0);
+    }
+
+    void spec_vector()
+    {
+        tools::Cipher c(kKey);
+        c.set_mac(kMac);
+
+        uint8_t nonce[tools::Cipher::kNonceSize];
+        c.make_nonce(kPlain, kCounter, nonce);
+        BTHOME_CHECK(std::memcmp(nonce, kNonce, sizeof(kNonce)) == 0);
+
+        uint8_t res[sizeof(kPlain) + tools::Cipher::kOverhead];
+        c.encrypt(kPlain, sizeof(kPlain), kCounter, res);
+        BTHOME_CHECK(std::memcmp(res, kPlain, 3) == 0);
+        BTHOME_CHECK(std::memcmp(res + 3, kCipherText, sizeof(kCipherText)) == 0);
+        BTHOME_CHECK(std::memcmp(res + 3 + sizeof(kCipherText), kNonce + 9, 4) == 0);
+        BTHOME_CHECK(std::memcmp(res + 3 + sizeof(kCipherText) + 4, kMic, sizeof(kMic)) == 0);
+        BTHOME_CHECK(std::memcmp(res, kFrame, sizeof(kFrame)) == 0);
+
+        std::vector<uint8_t> plain;
+        BTHOME_CHECK(decrypt({kFrame, kFrame + sizeof(kFrame)}, kMac, plain));
+        BTHOME_CHECK(plain == std::vector<uint8_t>(kPlain, kPlain + sizeof(kPlain)));
+
+        //a flipped bit anywhere after the header fails the MIC
+        std::vector<uint8_t> bad(kFrame, kFrame + sizeof(kFrame));
+        bad[5] ^= 0x10;
+        BTHOME_CHECK(!decrypt(bad, kMac, plain));
+    }
+
+    //the example values sent by an advertisement: the frame on air is the one from the specification
+    void spec_advertisement()
+    {
+        using Adv = BasicAdvertisement<Encrypted<>, sizeof("test"), Temperature, Humidity>;
+        shim::reset();
+        Adv adv("test", Flags::None);
+        adv.set_encryption_key(kKey);
+        bt_addr_le_t addr{};
+        for(size_t i = 0; i < 6; ++i)
+            addr.a.val[i] = kMac[5 - i];//little-endian, as zephyr keeps it
+        adv.set_encryption_mac(addr);
+        adv.set_encryption_counter(kCounter);
+        //25.06 and 50.55 aren't exact in binary, the slight excess keeps them from truncating one step down
+        adv.update<Temperature>(25.062f);
+        adv.update<Humidity>(50.552f);
+
+        adv.advertise_with(&kParam, 100);
+        const auto frame = last_service_data();
+        BTHOME_CHECK(frame == std::vector<uint8_t>(kFrame, kFrame + sizeof(kFrame)));
+        BTHOME_CHECK(adv.get_encryption_counter() == kCounter + 1);
+
+        std::vector<uint8_t> plain;
+        BTHOME_CHECK(decrypt(frame, kMac, plain));
+        BTHOME_CHECK(plain == std::vector<uint8_t>(kPlain, kPlain + sizeof(kPlain)));
+    }
+
+    //payload over several AES blocks: decrypts to what the same advertisement sends unencrypted
+    void multi_block_advertisement()
+    {
+        using Enc = BasicAdvertisement<Encrypted<ExtAdvOptions>, sizeof("test"), Temperature, Humidity, Pressure, Illuminance,
+            Battery, CO2, TVOC, PM2_5, PM10, VoltageFine>;
+        using Plain = BasicAdvertisement<ExtAdvOptions, sizeof("test"), Temperature, Humidity, Pressure, Illuminance,
+            Battery, CO2, TVOC, PM2_5, PM10, VoltageFine>;
+        static_assert(Enc::kPacksCount == 1);
+
+        auto fill = [](auto &adv){
+            adv.template update<Temperature>(-5.5f);
+            adv.template update<Humidity>(40.f);
+            adv.template update<Pressure>(1013.25f);
+            adv.template update<Illuminance>(12345.f);
+            adv.template update<Battery>(87);
+            adv.template update<CO2>(800);
+            adv.template update<TVOC>(120);
+            adv.template update<PM2_5>(12);
+            adv.template update<PM10>(25);
+            adv.template update<VoltageFine>(3.012f);
+        };
+
+        shim::reset();
+        static Plain plainAdv("test", Flags::None);
+        fill(plainAdv);
+        plainAdv.advertise_with(&kExtParam, 100);
+        auto expected = last_service_data();
+        BTHOME_CHECK(expected.size() > tools::Cipher::kHeaderSize + 16);
+        expected[2] |= 0x01;//encryption flag in the device info byte
+
+        shim::reset();
+        static Enc adv("test", Flags::None);
+        adv.set_encryption_key(kKey);
+        bt_addr_le_t addr{};
+        for(size_t i = 0; i < 6; ++i)
+            addr.a.val[i] = kMac[5 - i];
+        adv.set_encryption_mac(addr);
+        fill(adv);
+        adv.advertise_with(&kExtParam, 100);
+        const auto frame = last_service_data();
+        BTHOME_CHECK(frame.size() == expected.size() + tools::Cipher::kOverhead);
+
+        std::vector<uint8_t> plain;
+        BTHOME_CHECK(decrypt(frame, kMac, plain));
+        BTHOME_CHECK(plain == expected);
+    }
+}
+
+int main()
+{
+    aes_block();
+    spec_vector();
+    spec_advertisement();
+    multi_block_advertisement();
+    return test::result();
+}
@@ -0,0 +1,161 @@
+//bt_le_* failures: a cycle that can't start is cut short and reports it,
+//a pack the controller didn't take stays dirty and is sent again
+#include "bthome/bthome_comp.hpp"
+#include "bthome_shim.hpp"
+#include "check.hpp"
+#include <cerrno>
+
+using namespace BTHome;
+using shim::Call;
+
+namespace
+{
+    //two packs
+    using Adv = decltype(Advertisement("test", Flags::None, Temperature{}, Humidity{}, Pressure{}, Illuminance{}, Battery{},
+        CO2{}, TVOC{}, PM2_5{}, PM10{}, VoltageFine{}));
+    static_assert(Adv::kPacksCount == 2);
+
+    const bt_le_adv_param kParam = BT_LE_ADV_PARAM_INIT(AdvOptions::kDefaultAdvOpt, BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, nullptr);
+
+    size_t data_frames()
+    {
+        size_t n = 0;
+        for(const auto &f : shim::frames())
+            n += f.has_data();
+        return n;
+    }
+
+    void start_failure()
+    {
+        shim::reset();
+        Adv adv("test", Flags::None);
+        shim::fail_next(Call::AdvStart, -ENOMEM);
+        BTHOME_CHECK(adv.advertise_with(&kParam, 100) == -ENOMEM);
+        BTHOME_CHECK(data_frames() == 0);
+        BTHOME_CHECK(shim::count(Call::AdvStop) == 0);
+        BTHOME_CHECK(shim::now_us() == 0);
+        BTHOME_CHECK(adv.dirty_packs() == 0b11);
+
+        BTHOME_CHECK(adv.advertise_changed() == 0);
+        BTHOME_CHECK(data_frames() == 2);
+        BTHOME_CHECK(adv.dirty_packs() == 0);
+    }
+
+    void update_failure()
+    {
+        shim::reset();
+        Adv adv("test", Flags::None);
+        shim::fail_next(Call::AdvUpdate, -EIO);
+        BTHOME_CHECK(adv.advertise_with(&kParam, 100) == 0);
+        BTHOME_CHECK(adv.dirty_packs() == 0b10);
+
+        shim::reset();
+        BTHOME_CHECK(adv.advertise_changed() == 0);
+        BTHOME_CHECK(data_frames() == 1);
+        BTHOME_CHECK(adv.dirty_packs() == 0);
+    }
+
+    void async_start_failure()
+    {
+        shim::reset();
+        static Adv adv("test", Flags::None);
+        static int done = 0;
+        shim::fail_next(Call::AdvStart, -ENOMEM);
+        adv.advertise_with_async(&kParam, 100, [](void*){ ++done; });
+        BTHOME_CHECK(shim::run_until_idle(1000));
+        BTHOME_CHECK(done == 1);
+        BTHOME_CHECK(!adv.is_advertising());
+        BTHOME_CHECK(adv.async_error() == -ENOMEM);
+        BTHOME_CHECK(data_frames() == 0);
+        BTHOME_CHECK(adv.dirty_packs() == 0b11);
+
+        adv.advertise_with_async(&kParam, 100, [](void*){ ++done; });
+        BTHOME_CHECK(shim::run_until_idle(1000));
+        BTHOME_CHECK(done == 2);
+        BTHOME_CHECK(adv.async_error() == 0);
+        BTHOME_CHECK(data_frames() == 2);
+    }
+
+    void refresh_failure()
+    {
+        shim::reset();
+        static Adv adv("test", Flags::None);
+        BTHOME_CHECK(adv.advertise_sets(&kParam));
+        adv.update<Temperature>(21.5f);
+        adv.update<CO2>(800);
+        shim::fail_next(Call::ExtSetData, -EIO);
+        adv.refresh_sets();
+        BTHOME_CHECK(shim::count(Call::ExtSetData) == 2 + 1);
+        BTHOME_CHECK(adv.dirty_packs() == 0b01);
+
+        adv.refresh_sets();
+        BTHOME_CHECK(shim::count(Call::ExtSetData) == 2 + 2);
+        BTHOME_CHECK(adv.dirty_packs() == 0);
+        adv.stop_sets(true);
+    }
+
+    //a pack a scheduler couldn't start is still due
+    void pack_start_failure()
+    {
+        shim::reset();
+        static Adv adv("test", Flags::None);
+        BTHOME_CHECK(adv.advertise_with(&kParam, 100) == 0);
+        adv.update<CO2>(800);
+        BTHOME_CHECK(adv.dirty_packs() == 0b10);
+        shim::fail_next(Call::AdvStart, -ENOMEM);
+        BTHOME_CHECK(adv.start_pack(1, &kParam) == -ENOMEM);
+        BTHOME_CHECK(adv.dirty_packs() == 0b10);
+
+        BTHOME_CHECK(adv.start_pack(1, &kParam) == 0);
+        BTHOME_CHECK(adv.dirty_packs() == 0);
+        BTHOME_CHECK(adv.stop_pack() == 0);
+    }
+
+    void periodic_start_failure()
+    {
+        using Per = BasicAdvertisement<Periodic<ExtAdvOptions>, sizeof("test"), Temperature, Humidity>;
+        shim::reset();
+        static Per adv("test", Flags::None);
+        shim::fail_next(Call::ExtStart, -ENOMEM);
+        BTHOME_CHECK(adv.advertise_periodic() == -ENOMEM);
+        BTHOME_CHECK(!adv.periodic_running());
+        BTHOME_CHECK(shim::count(Call::PerStop) == 1);
+
+        BTHOME_CHECK(adv.advertise_periodic() == 0);
+        BTHOME_CHECK(adv.periodic_running());
+        adv.update<Temperature>(21.5f);
+        BTHOME_CHECK(shim::run_until_idle(1000));
+        BTHOME_CHECK(shim::count(Call::PerSetData) == 2 + 1);
+        adv.stop_periodic();
+    }
+
+    void periodic_refresh_failure()
+    {
+        using Per = BasicAdvertisement<Periodic<ExtAdvOptions>, sizeof("test"), Temperature, Humidity>;
+        shim::reset();
+        static Per adv("test", Flags::None);
+        BTHOME_CHECK(adv.advertise_periodic() == 0);
+        adv.update<Temperature>(21.5f);
+        shim::fail_next(Call::PerSetData, -EIO);
+        BTHOME_CHECK(shim::run_until_idle(1000));
+        BTHOME_CHECK(adv.dirty_packs() == 0b1);
+
+        adv.update<Humidity>(40.f);
+        BTHOME_CHECK(shim::run_until_idle(1000));
+        BTHOME_CHECK(shim::count(Call::PerSetData) == 1 + 1);
+        BTHOME_CHECK(adv.dirty_packs() == 0);
+        adv.stop_periodic();
+    }
+}
+
+int main()
+{
+    start_failure();
+    update_failure();
+    async_start_failure();
+    refresh_failure();
+    pack_start_failure();
+    periodic_start_failure();
+    periodic_refresh_failure();
+    return test::result();
+}
@@ -0,0 +1,174 @@
+//send_event: the burst preempts a running async rotation, goes on air at the fast interval with the
+//trigger flag and a packet id, and the rotation resumes with the pack it was interrupted on
+#include "bthome/bthome_comp.hpp"
+#include "bthome/bthome_decoder.hpp"
+#include "bthome_shim.hpp"
+#include "check.hpp"
+#include <cerrno>
+
+using namespace BTHome;
+using shim::Call;
+
+namespace
+{
+    //two packs
+    using Adv = BasicAdvertisement<WithEvents<>, sizeof("test"), Temperature, Humidity, Pressure, Illuminance, Battery,
+        CO2, TVOC, PM2_5, PM10, VoltageFine>;
+    static_assert(Adv::kPacksCount == 2);
+    //the async and event state only take room with the policies that use them
+    using Plain = BasicAdvertisement<AdvOptions, sizeof("test"), Temperature, Humidity, Pressure, Illuminance, Battery,
+        CO2, TVOC, PM2_5, PM10, VoltageFine>;
+    using Blocking = BasicAdvertisement<BlockingOnly<>, sizeof("test"), Temperature, Humidity, Pressure, Illuminance, Battery,
+        CO2, TVOC, PM2_5, PM10, VoltageFine>;
+    static_assert(sizeof(Blocking) < sizeof(Plain) && sizeof(Plain) < sizeof(Adv));
+
+    const bt_le_adv_param kParam = BT_LE_ADV_PARAM_INIT(AdvOptions::kDefaultAdvOpt, BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, nullptr);
+    constexpr int kSlotMs = 1000;
+    constexpr int kBurstMs = 500;
+
+    Adv g_Adv("test", Flags::None);
+    int g_Done = 0;
+
+    const shim::Frame* last(Call c)
+    {
+        const auto &f = shim::frames();
+        for(auto it = f.rbegin(); it != f.rend(); ++it)
+            if (it->m_Call == c)
+                return &*it;
+        return nullptr;
+    }
+
+    struct Event
+    {
+        bool m_Trigger = false;
+        int64_t m_PacketId = -1;
+        int64_t m_Button = -1;
+    };
+
+    Event decode_event(const shim::Frame &f)
+    {
+        const auto svc = f.service_data();
+        Event e;
+        decoder::Header h;
+        decoder::decode(svc.data(), svc.size(), [&](const decoder::Object &o){
+            if (o.is<PacketId>())
+                e.m_PacketId = o.m_Raw;
+            else if (o.is<Button>())
+                e.m_Button = o.m_Raw;
+        }, &h);
+        e.m_Trigger = h.trigger();
+        return e;
+    }
+
+    void preempt_and_resume()
+    {
+        shim::reset();
+        g_Done = 0;
+        g_Adv.advertise_with_async(&kParam, kSlotMs, [](void*){ ++g_Done; });
+        shim::run_for(300);
+        const auto pack0 = last(Call::AdvStart)->service_data();
+
+        g_Adv.send_event<Button>(EButton::Press, kBurstMs);
+        shim::run_for(0);
+        //the rotation is stopped and the event goes out right away, at the fast interval
+        BTHOME_CHECK(shim::count(Call::AdvStop) == 1);
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 2);
+        const shim::Frame *pEvent = last(Call::AdvStart);
+        BTHOME_CHECK(pEvent->m_TimeUs == 300'000);
+        BTHOME_CHECK(pEvent->m_Param.interval_min == AdvOptions::kEventIntMin);
+        BTHOME_CHECK(pEvent->m_Param.interval_max == AdvOptions::kEventIntMax);
+        const Event e = decode_event(*pEvent);
+        BTHOME_CHECK(e.m_Trigger);
+        BTHOME_CHECK(e.m_PacketId == 0);
+        BTHOME_CHECK(e.m_Button == int64_t(EButton::Press));
+        BTHOME_CHECK(g_Adv.is_advertising());
+
+        //burst over: the interrupted pack is sent again with the cycle's parameters
+        shim::run_for(kBurstMs);
+        BTHOME_CHECK(shim::count(Call::AdvStop) == 2);
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 3);
+        const shim::Frame *pResumed = last(Call::AdvStart);
+        BTHOME_CHECK(pResumed->m_TimeUs == 300'000 + kBurstMs * 1000);
+        BTHOME_CHECK(pResumed->m_Param.interval_min == BT_GAP_ADV_SLOW_INT_MIN);
+        BTHOME_CHECK(pResumed->service_data() == pack0);
+        BTHOME_CHECK(!decode_event(*pResumed).m_Trigger);
+
+        //the rest of the cycle: pack 1 for a slot, then done
+        BTHOME_CHECK(shim::run_until_idle(10 * kSlotMs));
+        BTHOME_CHECK(g_Done == 1);
+        BTHOME_CHECK(!g_Adv.is_advertising());
+        BTHOME_CHECK(shim::count(Call::AdvUpdate) == 1);
+        BTHOME_CHECK(shim::now_us() == (300 + kBurstMs + 2 * kSlotMs) * 1000);
+        BTHOME_CHECK(!shim::legacy_advertising());
+    }
+
+    void event_replaces_event()
+    {
+        shim::reset();
+        g_Adv.send_event<Button>(EButton::Press, kBurstMs);
+        shim::run_for(100);
+        g_Adv.send_event<Button>(EButton::DoublePress, kBurstMs);
+        shim::run_for(0);
+        //the second one takes over the burst on air and gets a new packet id
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 1);
+        BTHOME_CHECK(shim::count(Call::AdvUpdate) == 1);
+        const Event e = decode_event(*last(Call::AdvUpdate));
+        BTHOME_CHECK(e.m_Button == int64_t(EButton::DoublePress));
+        BTHOME_CHECK(e.m_PacketId == decode_event(*last(Call::AdvStart)).m_PacketId + 1);
+
+        //the burst is extended from the last event, nothing to resume
+        BTHOME_CHECK(shim::run_until_idle(10 * kBurstMs));
+        BTHOME_CHECK(shim::now_us() == (100 + kBurstMs) * 1000);
+        BTHOME_CHECK(shim::count(Call::AdvStop) == 1);
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 1);
+        BTHOME_CHECK(!shim::legacy_advertising());
+    }
+
+    //the controller refuses the burst: the event is dropped and the rotation goes on
+    void start_failure()
+    {
+        shim::reset();
+        g_Done = 0;
+        g_Adv.advertise_with_async(&kParam, kSlotMs, [](void*){ ++g_Done; });
+        shim::run_for(300);
+        const auto pack0 = last(Call::AdvStart)->service_data();
+
+        shim::fail_next(Call::AdvStart, -ENOMEM);
+        g_Adv.send_event<Button>(EButton::Press, kBurstMs);
+        shim::run_for(0);
+        BTHOME_CHECK(shim::count(Call::AdvStop) == 1);
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 2);
+        const shim::Frame *pResumed = last(Call::AdvStart);
+        BTHOME_CHECK(pResumed->m_TimeUs == 300'000);
+        BTHOME_CHECK(pResumed->m_Param.interval_min == BT_GAP_ADV_SLOW_INT_MIN);
+        BTHOME_CHECK(pResumed->service_data() == pack0);
+
+        BTHOME_CHECK(shim::run_until_idle(10 * kSlotMs));
+        BTHOME_CHECK(g_Done == 1);
+        BTHOME_CHECK(shim::now_us() == (300 + 2 * kSlotMs) * 1000);
+        BTHOME_CHECK(!shim::legacy_advertising());
+    }
+
+    //without the async state the blocking and set paths still work
+    void blocking_only()
+    {
+        shim::reset();
+        static Blocking adv("test", Flags::None);
+        BTHOME_CHECK(adv.advertise_with(&kParam, 100) == 0);
+        BTHOME_CHECK(!adv.is_advertising());
+        adv.cancel();
+        BTHOME_CHECK(adv.advertise_sets(&kParam));
+        adv.stop_sets(true);
+        BTHOME_CHECK(shim::count(Call::AdvStart) == 1);
+        BTHOME_CHECK(shim::count(Call::ExtStart) == Blocking::kPacksCount);
+    }
+}
+
+int main()
+{
+    preempt_and_resume();
+    event_replaces_event();
+    start_failure();
+    blocking_only();
+    return test::result();
+}
@@ -0,0 +1,117 @@
+//RuntimeAdvertisementsList against the compile time list: the same schema built both ways
+//must give byte-identical packs, as laid out at init and after every object was updated
+#include "bthome/bthome_comp.hpp"
+#include "bthome/bthome_runtime.hpp"
+#include "bthome_shim.hpp"
+#include "check.hpp"
+#include <vector>
+
+using namespace BTHome;
+
+namespace
+{
+    const bt_le_adv_param kParam = BT_LE_ADV_PARAM_INIT(AdvOptions::kDefaultAdvOpt, BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, nullptr);
+    const bt_le_adv_param kExtParam = BT_LE_ADV_PARAM_INIT(ExtAdvOptions::kDefaultAdvOpt, BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, nullptr);
+
+    //object I is the how many-th of its type
+    template<size_t I, class... T>
+    constexpr size_t OccurrenceOf()
+    {
+        using X = tools::NthType<I, T...>;
+        size_t n = 0, k = 0;
+        ((n += (k++ < I && std::is_same_v<X, T>)), ...);
+        return n;
+    }
+
+    //a different wire value for every object, given as an integer or, to float objects, as Scaled
+    template<class X>
+    constexpr auto ValueOf(size_t i)
+    {
+        const uint32_t v = uint32_t(0x01010101u * (i + 1)) ^ 0x40402010u;
+        if constexpr (std::is_constructible_v<X, Scaled>)
+        {
+            //in the range of the wire type, Scaled saturates
+            int64_t w = X::kDataSize < 4 ? v & ((uint32_t(1) << X::kDataSize * 8) - 1) : v;
+            if (X::kSigned && w >= (int64_t(1) << (X::kDataSize * 8 - 1)))
+                w -= int64_t(1) << X::kDataSize * 8;
+            return Scaled{int32_t(w)};
+        }
+        else
+            return v;
+    }
+
+    //first-fit-decreasing only runs above LayoutEngine::kExactSearchLimit objects
+    template<size_t SizeLimit, class... T>
+    constexpr bool BeatsNextFit()
+    {
+        constexpr uint8_t ids[] = {T::kDataId...};
+        constexpr uint8_t costs[] = {uint8_t(1 + T::kDataSize)...};
+        const tools::LayoutEngine<sizeof...(T)> e(ids, costs, sizeof...(T), SizeLimit);
+        uint8_t bin[sizeof...(T)]{};
+        return sizeof...(T) > e.kExactSearchLimit && e.compute().m_Packs < e.next_fit(bin);
+    }
+
+    //the packs the advertisement sends, in pack order
+    template<class Adv>
+    std::vector<std::vector<uint8_t>> sent_packs(Adv &adv, const bt_le_adv_param *pParam)
+    {
+        shim::reset();
+        BTHOME_CHECK(adv.advertise_with(pParam, 10) == 0);
+        std::vector<std::vector<uint8_t>> packs;
+        for(const auto &f : shim::frames())
+            if (f.has_data())
+                packs.push_back(f.service_data());
+        BTHOME_CHECK(packs.size() == Adv::kPacksCount);
+        return packs;
+    }
+
+    template<class R>
+    std::vector<std::vector<uint8_t>> runtime_packs(const R &r)
+    {
+        std::vector<std::vector<uint8_t>> packs;
+        for(size_t p = 0; p < r.packs_count(); ++p)
+            packs.emplace_back(r.pack_data(p), r.pack_data(p) + r.pack_size(p));
+        return packs;
+    }
+
+    template<class Options, class... T, size_t N>
+    void compare(const char (&name)[N], const bt_le_adv_param *pParam)
+    {
+        using Adv = BasicAdvertisement<Options, N, T...>;
+        static Adv adv(name, Flags::Trigger);
+        static StaticRuntimeAdvertisementsList<sizeof...(T)> rt;
+        const uint8_t ids[] = {T::kDataId...};
+        BTHOME_CHECK(rt.init(ids, sizeof...(T), Adv::kAllowedSensorPayload, Flags::Trigger) == SchemaError::Ok);
+        BTHOME_CHECK(rt.packs_count() == Adv::kPacksCount);
+        BTHOME_CHECK(runtime_packs(rt) == sent_packs(adv, pParam));
+
+        [&]<size_t... I>(std::index_sequence<I...>)
+        {
+            (adv.template update_nth<T, OccurrenceOf<I, T...>()>(ValueOf<T>(I)), ...);
+            (rt.template update_nth<T>(OccurrenceOf<I, T...>(), ValueOf<T>(I)), ...);
+        }(std::index_sequence_for<T...>{});
+        BTHOME_CHECK(runtime_packs(rt) == sent_packs(adv, pParam));
+    }
+}
+
+int main()
+{
+    static_assert(LegacySensorPayload(sizeof("test")) == Advertisement<sizeof("test")>::kAllowedSensorPayload);
+
+    //exact search, two packs
+    compare<AdvOptions, Temperature, Humidity, Pressure, Illuminance, Battery, CO2, TVOC, PM2_5, PM10, VoltageFine>("test", &kParam);
+    //repeated types are updated by occurrence
+    compare<AdvOptions, Temperature, Humidity, Temperature, Battery, Count4, Temperature, Count1>("test", &kParam);
+    //objects given out of id order
+    compare<AdvOptions, Timestamp, PM10, Battery, Energy, Temperature>("test", &kParam);
+
+    //first-fit-decreasing saves a pack over declaration order
+    static_assert(BeatsNextFit<LegacySensorPayload(sizeof("t")), Pressure, Temperature, Count4, Humidity, Battery, Power, Count1,
+        Energy, Battery, Timestamp, CO2>());
+    compare<AdvOptions, Pressure, Temperature, Count4, Humidity, Battery, Power, Count1, Energy, Battery, Timestamp, CO2>("t", &kParam);
+
+    //extended advertising: many objects in a single big pack
+    compare<ExtAdvOptions, Temperature, Humidity, Pressure, Illuminance, Battery, CO2, TVOC, PM2_5, PM10, VoltageFine,
+        Count4, Energy, Power, Timestamp, Temperature, Humidity, Count1, Gas, Water, Direction>("test", &kExtParam);
+    return test::result();
+}
@@ -0,0 +1,212 @@
+#ifndef BTHOME_ACCUM_HPP
+#define BTHOME_ACCUM_HPP
+#include <errno.h>
+#include "bthome_comp.hpp"
+#if defined(CONFIG_SETTINGS)
+#include <zephyr/settings/settings.h>
+#endif
+
+namespace BTHome
+{
+    struct AccumulatorConfig
+    {
+        const char *m_pKey = nullptr;//settings key, e.g. "bthome/energy"; null - not persisted
+        uint32_t m_MinWriteIntervalMs = 15 * 60 * 1000;//at most one flash write per interval
+        uint32_t m_MinWriteDelta = 1;//and only once the total moved by that many wire units
+    };
+
+    //Running total (Energy, Count4, Water, Gas, VolumeStorage...) of the Nth X in Adv.
+    //Increments are integrated in 64 bit fixed point in wire units of X (Wh for Energy, mL for Water,
+    //pulses for Count4), so nothing is lost to float rounding however small or frequent they are.
+    //The advertised value wraps around at the wire width like the meter it models would.
+    //The add_* calls are ISR safe and don't allocate; publish() is for thread context.
+    //With a settings key the total survives reboots: writes are batched and bounded by AccumulatorConfig.
+    //Nothing is written before restore() succeeded, so the saved total can't be overwritten by the increments
+    //since boot; they are counted meanwhile and added to it.
+    template<class Adv, class X, size_t Nth = 0>
+    struct Accumulator
+    {
+        static_assert(!X::kSigned, "Running totals need an unsigned object");
+        static_assert(requires(uint8_t *p) { X::encode(RawValue{}, p); }, "Not a numeric object");
+        static_assert(Adv::template kIndexOf<X, Nth> != tools::kNotFound, "Data type not found");
+
+        static constexpr int kFracBits = 16;
+        static constexpr int64_t kOne = int64_t(1) << kFracBits;
+
+        //the work item is set up here, not on first use, as the first add may come from an ISR
+        Accumulator(Adv &adv, AccumulatorConfig cfg = {}):
+            m_Adv(adv),
+            m_Config(cfg),
+            m_LastWriteMs(k_uptime_get_32())
+        {
+            k_work_init_delayable(&m_Checkpoint.m_Work, &on_checkpoint);
+            m_Checkpoint.m_pSelf = this;
+        }
+
+        //pulse_weight: wire units per pulse in 1/65536, e.g. kOne / 2 for a 2000 imp/kWh meter on Energy
+        void set_pulse_weight(int64_t pulse_weight) { m_PulseWeight = pulse_weight; }
+
+        void add_pulses(uint32_t n)
+        {
+            add_fixed(int64_t(n) * m_PulseWeight);
+        }
+
+        //rate in wire units per hour over dt_ms, e.g. watts for Energy (Wh)
+        //what falls below the 1/65536 resolution is carried over to the next call, so frequent short samples
+        //add up to the same total as one long one
+        void add_rate(int32_t rate_per_hour, uint32_t dt_ms)
+        {
+            k_spinlock_key_t key = k_spin_lock(&m_Lock);
+            m_RateRest += int64_t(rate_per_hour) * int64_t(dt_ms) * kOne;
+            const int64_t whole = m_RateRest / kMsPerHour;
+            m_RateRest -= whole * kMsPerHour;
+            m_Total += whole;
+            k_spin_unlock(&m_Lock, key);
+            if (m_Config.m_pKey)
+                schedule_checkpoint();
+        }
+
+        //increment in wire units, 1/65536 resolution
+        void add_fixed(int64_t v)
+        {
+            k_spinlock_key_t key = k_spin_lock(&m_Lock);
+            m_Total += v;
+            k_spin_unlock(&m_Lock, key);
+            if (m_Config.m_pKey)
+                schedule_checkpoint();
+        }
+
+        //in wire units, 1/65536 resolution
+        int64_t total_fixed() const
+        {
+            k_spinlock_key_t key = k_spin_lock(&m_Lock);
+            const int64_t total = m_Total;
+            k_spin_unlock(&m_Lock, key);
+            return total;
+        }
+
+        void set_total_fixed(int64_t v)
+        {
+            k_spinlock_key_t key = k_spin_lock(&m_Lock);
+            m_Total = v;
+            m_RateRest = 0;
+            k_spin_unlock(&m_Lock, key);
+            if (m_Config.m_pKey)
+                schedule_checkpoint();
+        }
+
+        //returns true if the advertised value changed
+        bool publish()
+        {
+            return m_Adv.template update_nth<X, Nth>(RawValue{uint32_t(uint64_t(total_fixed()) >> kFracBits)});
+        }
+
+        //loads the saved total (call after settings_load or settings_subsys_init) and publishes it
+        //with a settings key it must be called once, also on the very first boot, before anything is written
+        int restore()
+        {
+#if defined(CONFIG_SETTINGS)
+            if (!m_Config.m_pKey)
+                return -EINVAL;
+            int64_t saved = 0;
+            const int err = settings_load_subtree_direct(m_Config.m_pKey, &on_load, &saved);
+            if (err)
+                return err;
+            k_spinlock_key_t key = k_spin_lock(&m_Lock);
+            m_Total += saved;//increments that came in before the restore are kept
+            const bool moved = m_Total != saved;
+            k_spin_unlock(&m_Lock, key);
+            m_Saved = saved;
+            atomic_set(&m_Restored, 1);
+            publish();
+            if (moved)
+                schedule_checkpoint();
+            return 0;
+#else
+            return -ENOTSUP;
+#endif
+        }
+
+        //writes the total right away if it moved, e.g. before a planned reset; -EAGAIN before restore()
+        int flush()
+        {
+            k_work_sync sync;
+            k_work_cancel_delayable_sync(&m_Checkpoint.m_Work, &sync);
+            return checkpoint(1);
+        }
+
+    private:
+        static constexpr int64_t kMsPerHour = 3600 * 1000;
+
+        //writes are at least m_MinWriteIntervalMs apart, counted from boot for the first one
+        void schedule_checkpoint()
+        {
+            //restore() schedules it once the saved total is known
+            if (!atomic_get(&m_Restored))
+                return;
+            const uint32_t since = k_uptime_get_32() - m_LastWriteMs;
+            const uint32_t wait = since < m_Config.m_MinWriteIntervalMs ? m_Config.m_MinWriteIntervalMs - since : 0;
+            //no-op if already scheduled, so any number of increments in between costs a single write
+            k_work_schedule(&m_Checkpoint.m_Work, K_MSEC(wait));
+        }
+
+        static void on_checkpoint(k_work *pWork)
+        {
+            auto *pSelf = CONTAINER_OF(k_work_delayable_from_work(pWork), CheckpointState, m_Work)->m_pSelf;
+            pSelf->checkpoint(pSelf->m_Config.m_MinWriteDelta);
+        }
+
+        int checkpoint(uint32_t min_delta)
+        {
+#if defined(CONFIG_SETTINGS)
+            if (!m_Config.m_pKey)
+                return 0;
+            if (!atomic_get(&m_Restored))
+                return -EAGAIN;
+            const int64_t total = total_fixed();
+            const int64_t delta = total - m_Saved;
+            if ((delta < 0 ? -delta : delta) < int64_t(min_delta) * kOne)
+                return 0;
+            const int err = settings_save_one(m_Config.m_pKey, &total, sizeof(total));
+            if (!err)
+            {
+                m_Saved = total;
+                m_LastWriteMs = k_uptime_get_32();
+            }
+            return err;
+#else
+            return 0;
+#endif
+        }
+
+#if defined(CONFIG_SETTINGS)
+        static int on_load(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg, void *param)
+        {
+            const char *next;
+            if (settings_name_next(key, &next) || len != sizeof(int64_t))
+                return 0;
+            const ssize_t read = read_cb(cb_arg, param, len);
+            return read < 0 ? int(read) : 0;
+        }
+#endif
+
+        struct CheckpointState
+        {
+            k_work_delayable m_Work;
+            Accumulator *m_pSelf = nullptr;
+        };
+
+        Adv &m_Adv;
+        AccumulatorConfig m_Config;
+        mutable k_spinlock m_Lock{};
+        int64_t m_Total = 0;//wire units << kFracBits
+        int64_t m_RateRest = 0;//add_rate remainder, in 1/kMsPerHour of m_Total's unit
+        int64_t m_PulseWeight = kOne;
+        int64_t m_Saved = 0;//last persisted total, only touched from thread context
+        atomic_t m_Restored = ATOMIC_INIT(0);//the saved total was loaded, writes may go ahead
+        uint32_t m_LastWriteMs;
+        CheckpointState m_Checkpoint{};
+    };
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef BTHOME_ADAPTIVE_HPP
+#define BTHOME_ADAPTIVE_HPP
+#include "bthome_comp.hpp"
+#include "bthome_decoder.hpp"
+
+namespace BTHome
+{
+    struct AdaptiveConfig
+    {
+        int m_PackDurationMs = 1500;//how long each pack is on air within a cycle
+        int m_FastPauseMs = 1000;//pause between cycles right after a significant change
+        int m_SlowPauseMs = 60000;//the pause doubles up to this while readings are stable
+    };
+
+    //Runs advertising cycles of Adv with a pause in between that adapts to the data:
+    //a significant change (beyond Deadband<X>) starts a cycle right away and resets the pause to the fast one,
+    //every cycle without one doubles the pause up to the slow one.
+    //Only the pause adapts, the advertising interval within a cycle stays at BT_GAP_ADV_SLOW_INT_*.
+    //Updates must go through the scheduler to be taken into account.
+    template<class Adv>
+    struct AdaptiveScheduler
+    {
+        AdaptiveScheduler(Adv &adv, AdaptiveConfig cfg = {}):
+            m_Adv(adv),
+            m_Config(cfg),
+            m_PauseMs(cfg.m_FastPauseMs)
+        {
+            init_reported(std::make_index_sequence<Adv::AdvLayout::kObjects>{});
+        }
+
+        //returns true if the change was significant
+        template<class X, class Value>
+        bool update(Value v)
+        {
+            return update_nth<X, 0, Value>(v);
+        }
+
+        template<class X, size_t Nth, class Value>
+        bool update_nth(Value v)
+        {
+            if (!m_Adv.template update_nth<X, Nth, Value>(v))
+                return false;
+
+            constexpr size_t kIdx = Adv::template kIndexOf<X, Nth>;
+            const int64_t raw = decoder::ReadRaw(m_Adv.template encoded_value<kIdx>(), decoder::InfoOf<X>());
+            const int64_t diff = raw - m_Reported[kIdx];
+            if ((diff < 0 ? -diff : diff) < int64_t(Deadband<X>::kRaw))
+                return false;
+
+            m_Reported[kIdx] = raw;
+            atomic_set(&m_Significant, 1);
+            //waiting for the next cycle: start it now; a running cycle will pick up the change
+            if (m_Running && !m_Adv.is_advertising())
+                k_work_reschedule(&m_Work.m_Work, K_NO_WAIT);
+            return true;
+        }
+
+        void start()
+        {
+            if (!m_Work.m_pSelf)
+            {
+                k_work_init_delayable(&m_Work.m_Work, &on_work);
+                m_Work.m_pSelf = this;
+            }
+            m_PauseMs = m_Config.m_FastPauseMs;
+            m_Running = true;
+            k_work_reschedule(&m_Work.m_Work, K_NO_WAIT);
+        }
+
+        void stop()
+        {
+            m_Running = false;
+            k_work_sync sync;
+            k_work_cancel_delayable_sync(&m_Work.m_Work, &sync);
+            m_Adv.cancel();
+        }
+
+        //current pause between the end of a cycle and the start of the next one
+        int cycle_pause_ms() const { return m_PauseMs; }
+
+    private:
+        template<size_t... I>
+        void init_reported(std::index_sequence<I...>)
+        {
+            ((m_Reported[I] = decoder::ReadRaw(m_Adv.template encoded_value<I>(), decoder::InfoOf<typename Adv::template ObjectType<I>>())), ...);
+        }
+
+        static void on_work(k_work *pWork)
+        {
+            CONTAINER_OF(k_work_delayable_from_work(pWork), WorkState, m_Work)->m_pSelf->start_cycle();
+        }
+
+        static void on_cycle_done(void *pCtx)
+        {
+            static_cast<AdaptiveScheduler*>(pCtx)->cycle_done();
+        }
+
+        void start_cycle()
+        {
+            if (!m_Running)
+                return;
+            //someone else's cycle is on air: try again after a pause instead of waiting for a callback that isn't ours
+            if (m_Adv.is_advertising())
+            {
+                k_work_schedule(&m_Work.m_Work, K_MSEC(m_PauseMs));
+                return;
+            }
+            const struct bt_le_adv_param adv_param[] = {
+                BT_LE_ADV_PARAM_INIT(Adv::OptionsType::kDefaultAdvOpt, BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, nullptr)
+            };
+            m_Adv.advertise_with_async(adv_param, m_Config.m_PackDurationMs, &on_cycle_done, this);
+        }
+
+        void cycle_done()
+        {
+            if (atomic_clear(&m_Significant))
+                m_PauseMs = m_Config.m_FastPauseMs;
+            else
+                m_PauseMs = m_PauseMs * 2 < m_Config.m_SlowPauseMs ? m_PauseMs * 2 : m_Config.m_SlowPauseMs;
+            if (m_Running)
+                k_work_schedule(&m_Work.m_Work, K_MSEC(m_PauseMs));
+        }
+
+        struct WorkState
+        {
+            k_work_delayable m_Work;
+            AdaptiveScheduler *m_pSelf = nullptr;
+        };
+
+        Adv &m_Adv;
+        AdaptiveConfig m_Config;
+        WorkState m_Work{};
+        int m_PauseMs;
+        bool m_Running = false;
+        atomic_t m_Significant = ATOMIC_INIT(0);
+        int64_t m_Reported[Adv::AdvLayout::kObjects];//last significant raw value of every object
+    };
+}
+
+#endif
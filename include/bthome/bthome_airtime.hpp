@@ -0,0 +1,68 @@
+#ifndef BTHHOME_AIRTIME_HPP_
+#define BTHHOME_AIRTIME_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+//Compile time model of the radio time and charge of advertising, 1M PHY.
+//Doesn't depend on zephyr so configurations can be compared on a host.
+namespace BTHome
+{
+    namespace airtime
+    {
+        inline constexpr uint32_t kUsPerByte = 8;//1M PHY
+        inline constexpr uint32_t kAdvChannels = 3;
+        //preamble + access address + PDU header + CRC
+        inline constexpr uint32_t kPduFraming = 1 + 4 + 2 + 3;
+
+        //ADV_NONCONN_IND/ADV_SCAN_IND: AdvA + AdvData
+        constexpr uint32_t LegacyPduUs(size_t advDataLen)
+        {
+            return uint32_t(kPduFraming + 6/*AdvA*/ + advDataLen) * kUsPerByte;
+        }
+
+        //ADV_EXT_IND on the primary channels: extended header with ADI and AuxPtr, no data
+        inline constexpr uint32_t kExtIndUs = (kPduFraming + 1/*length, mode*/ + 1/*flags*/ + 2/*ADI*/ + 3/*AuxPtr*/) * kUsPerByte;
+
+        //AUX_ADV_IND on a secondary channel: AdvA, ADI and the data
+        constexpr uint32_t AuxPduUs(size_t advDataLen)
+        {
+            return uint32_t(kPduFraming + 1 + 1 + 6/*AdvA*/ + 2/*ADI*/ + advDataLen) * kUsPerByte;
+        }
+
+        //TX time of one advertising event, scan responses not counted
+        constexpr uint32_t EventUs(size_t advDataLen, bool extended)
+        {
+            return extended ? kAdvChannels * kExtIndUs + AuxPduUs(advDataLen) : kAdvChannels * LegacyPduUs(advDataLen);
+        }
+
+        //PDUs sent per advertising event
+        constexpr uint32_t EventPdus(bool extended) { return extended ? kAdvChannels + 1 : kAdvChannels; }
+
+        //defaults are rough nRF52832 figures at 0 dBm with the DC/DC converter on,
+        //measure the actual board and TX power to get meaningful absolute numbers
+        struct PowerProfile
+        {
+            float m_TxMa = 5.3f;//radio transmitting
+            float m_OverheadMa = 3.f;//radio ramp-up and CPU around every PDU and event
+            uint32_t m_PduOverheadUs = 140;//ramp-up per PDU
+            uint32_t m_EventOverheadUs = 500;//HFXO start and stack processing per event
+            float m_SleepUa = 1.9f;//between events
+        };
+
+        //charge of one advertising event in uC (mA * us / 1000)
+        constexpr float EventChargeUc(uint32_t airtimeUs, bool extended, const PowerProfile &p)
+        {
+            const uint32_t overheadUs = EventPdus(extended) * p.m_PduOverheadUs + p.m_EventOverheadUs;
+            return (p.m_TxMa * float(airtimeUs) + p.m_OverheadMa * float(overheadUs)) / 1000.f;
+        }
+
+        //advertising events that fit into a slot, at least one
+        constexpr uint32_t EventsPerSlot(uint32_t intervalMs, uint32_t slotMs)
+        {
+            return intervalMs && slotMs > intervalMs ? slotMs / intervalMs : 1;
+        }
+    }
+}
+
+#endif
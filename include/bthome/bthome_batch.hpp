@@ -0,0 +1,106 @@
+#ifndef BTHOME_BATCH_HPP
+#define BTHOME_BATCH_HPP
+#include "bthome_comp.hpp"
+
+namespace BTHome
+{
+    //Collects samples of X in a ring buffer and publishes the last N of them at once
+    //into the first N X objects of Adv (oldest first), so the radio wakes up once per N samples.
+    //Stamp is void, Timestamp (unix time of the oldest published sample) or Duration (interval between samples);
+    //Adv must declare it as well.
+    //push() may be called from any thread or ISR, publish() from the advertising thread.
+    template<class Adv, class X, size_t N, class Stamp = void, class Value = float>
+    struct SampleBatch
+    {
+        static_assert(N > 0, "Empty batch");
+        static_assert(Adv::template kIndexOf<X, N - 1> != tools::kNotFound, "Adv needs N objects of X");
+        static constexpr bool kStamped = !std::is_void_v<Stamp>;
+        static_assert(!kStamped || std::is_same_v<Stamp, Timestamp> || std::is_same_v<Stamp, Duration>, "Stamp must be Timestamp or Duration");
+        static_assert(!kStamped || Adv::template kIndexOf<Stamp> != tools::kNotFound, "Adv has no Stamp object");
+
+        SampleBatch(Adv &adv):
+            m_Adv(adv)
+        {}
+
+        //returns true once N samples arrived since the last publish()
+        bool push(Value v) requires (!kStamped)
+        {
+            return push_sample(v, 0);
+        }
+
+        //tMs: time of the sample in ms, unix time for Timestamp, any monotonic clock (k_uptime_get()) for Duration
+        bool push(Value v, int64_t tMs) requires kStamped
+        {
+            return push_sample(v, tMs);
+        }
+
+        //samples pushed since the last publish()
+        size_t pending() const { return m_Pending; }
+        bool ready() const { return m_Pending >= N; }
+
+        //writes the last N samples (fewer if not collected yet, the rest of the slots keep their values)
+        //and the stamp into Adv as one batch; returns true if any pack changed
+        bool publish()
+        {
+            Value samples[N];
+            int64_t times[N]{};
+
+            k_spinlock_key_t key = k_spin_lock(&m_Lock);
+            const size_t count = m_Count;
+            for(size_t i = 0; i < count; ++i)
+            {
+                const size_t slot = (m_Head + N - count + i) % N;
+                samples[i] = m_Samples[slot];
+                if constexpr (kStamped)
+                    times[i] = m_Times[slot];
+            }
+            m_Pending = 0;
+            k_spin_unlock(&m_Lock, key);
+
+            if (!count)
+                return false;
+
+            bool changed = false;
+            m_Adv.batch([&]{
+                [&]<size_t... I>(std::index_sequence<I...>)
+                {
+                    ((changed |= I < count && m_Adv.template update_nth<X, I>(samples[I])), ...);
+                }(std::make_index_sequence<N>{});
+
+                if constexpr (std::is_same_v<Stamp, Timestamp>)
+                    changed |= m_Adv.template update<Timestamp>(uint32_t(times[0] / 1000));
+                else if constexpr (std::is_same_v<Stamp, Duration>)
+                {
+                    if (count > 1)
+                        changed |= m_Adv.template update<Duration>(float(times[count - 1] - times[0]) / float(count - 1) / 1000.f);
+                }
+            });
+            return changed;
+        }
+
+    private:
+        bool push_sample(Value v, int64_t tMs)
+        {
+            k_spinlock_key_t key = k_spin_lock(&m_Lock);
+            m_Samples[m_Head] = v;
+            if constexpr (kStamped)
+                m_Times[m_Head] = tMs;
+            m_Head = (m_Head + 1) % N;
+            if (m_Count < N)
+                ++m_Count;
+            const bool full = ++m_Pending >= N;
+            k_spin_unlock(&m_Lock, key);
+            return full;
+        }
+
+        Adv &m_Adv;
+        k_spinlock m_Lock{};
+        Value m_Samples[N]{};
+        [[no_unique_address]] std::conditional_t<kStamped, int64_t[N], tools::Empty> m_Times{};
+        size_t m_Head = 0;//next slot to write
+        size_t m_Count = 0;//valid samples, up to N
+        size_t m_Pending = 0;
+    };
+}
+
+#endif
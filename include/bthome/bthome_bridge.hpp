@@ -0,0 +1,145 @@
+#ifndef BTHOME_BRIDGE_HPP
+#define BTHOME_BRIDGE_HPP
+#include "bthome_comp.hpp"
+#include "bthome_schedule.hpp"
+
+namespace BTHome
+{
+    struct BridgeConfig
+    {
+        int m_SlotMs = 100;//how long a pack is on air, a few advertising events at the interval below
+        uint32_t m_IntMin = BT_GAP_ADV_FAST_INT_MIN_1;
+        uint32_t m_IntMax = BT_GAP_ADV_FAST_INT_MAX_1;
+    };
+
+    //One node advertising many virtual devices (e.g. wired sensors of a gateway), each one an
+    //Advertisement of its own with its own identity, so receivers see separate addresses.
+    //The packs of all the devices are interleaved on one advertiser by BridgeSchedule.
+    //Legacy advertising needs CONFIG_BT_ID_MAX >= devices + 1; with extended advertising every
+    //device also keeps its own set, so CONFIG_BT_EXT_ADV_MAX_ADV_SET >= devices as well.
+    //The advertisements must not be advertised by other means while the bridge runs;
+    //updating them from any thread is fine (double buffered ones for multi-object consistency).
+    template<size_t MaxDevices>
+    struct Bridge
+    {
+        Bridge(BridgeConfig cfg = {}):
+            m_Config(cfg)
+        {}
+
+        //a new identity with a random static address for a device, or a negative error
+        static int create_identity()
+        {
+            return bt_id_create(nullptr, nullptr);
+        }
+
+        //returns false if MaxDevices are already added
+        template<class Adv>
+        bool add(Adv &adv, uint8_t identity, int refresh_period_ms)
+        {
+            const size_t idx = m_Schedule.add(Adv::kPacksCount, refresh_period_ms, k_uptime_get());
+            if (idx == BridgeSchedule<MaxDevices>::kNone)
+                return false;
+            m_Devices[idx] = {&adv, &start_pack<Adv>, &stop_pack<Adv>, identity, Adv::OptionsType::kDefaultAdvOpt};
+            return true;
+        }
+
+        void start()
+        {
+            if (!m_Work.m_pSelf)
+            {
+                k_work_init_delayable(&m_Work.m_Work, &on_work);
+                m_Work.m_pSelf = this;
+            }
+            m_Running = true;
+            k_work_reschedule(&m_Work.m_Work, K_NO_WAIT);
+        }
+
+        void stop()
+        {
+            m_Running = false;
+            k_work_sync sync;
+            k_work_cancel_delayable_sync(&m_Work.m_Work, &sync);
+            stop_current();
+        }
+
+        const BridgeSchedule<MaxDevices>& schedule() const { return m_Schedule; }
+
+        //above 1000 the devices can't all meet their refresh period
+        uint32_t utilization() const { return m_Schedule.utilization(m_Config.m_SlotMs); }
+
+    private:
+        struct Device
+        {
+            void *m_pAdv = nullptr;
+            int (*m_pStart)(void *pAdv, size_t pack, const bt_le_adv_param *param) = nullptr;
+            int (*m_pStop)(void *pAdv) = nullptr;
+            uint8_t m_Identity = 0;
+            uint32_t m_Options = 0;
+        };
+
+        template<class Adv>
+        static int start_pack(void *pAdv, size_t pack, const bt_le_adv_param *param)
+        {
+            return static_cast<Adv*>(pAdv)->start_pack(pack, param);
+        }
+
+        template<class Adv>
+        static int stop_pack(void *pAdv)
+        {
+            return static_cast<Adv*>(pAdv)->stop_pack();
+        }
+
+        static void on_work(k_work *pWork)
+        {
+            CONTAINER_OF(k_work_delayable_from_work(pWork), WorkState, m_Work)->m_pSelf->step();
+        }
+
+        void stop_current()
+        {
+            if (m_Current == BridgeSchedule<MaxDevices>::kNone)
+                return;
+            Device &d = m_Devices[m_Current];
+            d.m_pStop(d.m_pAdv);
+            m_Current = BridgeSchedule<MaxDevices>::kNone;
+        }
+
+        void step()
+        {
+            //one advertiser: the previous device goes off air before the next one starts
+            stop_current();
+            if (!m_Running)
+                return;
+
+            int64_t wait_ms = 0;
+            const auto slot = m_Schedule.next(k_uptime_get(), m_Config.m_SlotMs, wait_ms);
+            if (slot.m_Device == BridgeSchedule<MaxDevices>::kNone)
+            {
+                if (wait_ms >= 0)
+                    k_work_schedule(&m_Work.m_Work, K_MSEC(wait_ms));
+                return;
+            }
+
+            Device &d = m_Devices[slot.m_Device];
+            bt_le_adv_param param = BT_LE_ADV_PARAM_INIT(d.m_Options, m_Config.m_IntMin, m_Config.m_IntMax, nullptr);
+            param.id = d.m_Identity;
+            if (!d.m_pStart(d.m_pAdv, slot.m_Pack, &param))
+                m_Current = slot.m_Device;
+            k_work_schedule(&m_Work.m_Work, K_MSEC(m_Config.m_SlotMs));
+        }
+
+        struct WorkState
+        {
+            k_work_delayable m_Work;
+            Bridge *m_pSelf = nullptr;
+        };
+
+        BridgeConfig m_Config;
+        BridgeSchedule<MaxDevices> m_Schedule;
+        Device m_Devices[MaxDevices]{};
+        WorkState m_Work{};
+        size_t m_Current = BridgeSchedule<MaxDevices>::kNone;
+        bool m_Running = false;
+    };
+}
+
+#endif
@@ -1,271 +1,1205 @@
 #ifndef BTHOME_COMP_HPP
 #define BTHOME_COMP_HPP
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
 #include "bthome.hpp"
+#include "bthome_pack.hpp"
+#include "bthome_crypto.hpp"
+#include "bthome_airtime.hpp"
 
 namespace BTHome
 {
-    namespace tools
+#if defined(CONFIG_BT_EXT_ADV) && defined(CONFIG_BT_EXT_ADV_MAX_ADV_SET)
+    inline constexpr size_t kMaxAdvSets = CONFIG_BT_EXT_ADV_MAX_ADV_SET;
+#else
+    inline constexpr size_t kMaxAdvSets = 0;
+#endif
+#if defined(CONFIG_BT_PER_ADV)
+    inline constexpr bool kPerAdvAvailable = true;
+#else
+    inline constexpr bool kPerAdvAvailable = false;
+#endif
+
+    //legacy advertising: 31 bytes per PDU, sensors are time-sliced into packs
+#if defined(CONFIG_BT_CTLR_ADV_DATA_LEN_MAX)
+    inline constexpr size_t kCtlrAdvDataLenMax = CONFIG_BT_CTLR_ADV_DATA_LEN_MAX;
+#else
+    //controller outside of the build (HCI), its limit isn't known here
+    inline constexpr size_t kCtlrAdvDataLenMax = 255 - (1 + 1 + 6 + 2);
+#endif
+
+    struct AdvOptions
+    {
+        static constexpr size_t kMaxAdvSize = 31;
+        static constexpr bool kExtended = false;
+        static constexpr bool kEncrypted = false;
+        static constexpr bool kDoubleBuffered = false;
+        static constexpr bool kNameInScanResponse = false;
+        static constexpr bool kStats = false;
+        static constexpr bool kPeriodic = false;
+        static constexpr bool kAsync = true;
+        static constexpr bool kEvents = false;
+        static constexpr uint32_t kDefaultAdvOpt = BT_LE_ADV_OPT_USE_IDENTITY;
+
+        //send_event bursts, see WithEvents
+        static constexpr uint32_t kEventIntMin = BT_GAP_ADV_FAST_INT_MIN_1;
+        static constexpr uint32_t kEventIntMax = BT_GAP_ADV_FAST_INT_MAX_1;
+        static constexpr int kEventBurstMs = 500;
+
+        //advertise_sets: interval offset between consecutive sets, in 0.625 ms units
+        static constexpr uint32_t kSetIntervalStagger = 8;
+    };
+
+    //BLE 5 extended advertising: everything goes into a single AUX_ADV_IND
+    struct ExtAdvOptions: AdvOptions
     {
-        template<class T>
-        constexpr size_t DataSizeOf = (T::kDataSize + 1);
+        //255 bytes of PDU payload - extended header (length/mode, flags, AdvA, ADI),
+        //capped by the controller's advertising data limit: CONFIG_BT_CTLR_ADV_DATA_LEN_MAX defaults to 31
+        //and has to be raised (to 251 for instance) to get more than a legacy sized pack
+        static constexpr size_t kMaxAdvSize = kCtlrAdvDataLenMax < 255 - (1 + 1 + 6 + 2) ? kCtlrAdvDataLenMax : 255 - (1 + 1 + 6 + 2);
+        static constexpr bool kExtended = true;
+        static constexpr uint32_t kDefaultAdvOpt = BT_LE_ADV_OPT_USE_IDENTITY | BT_LE_ADV_OPT_EXT_ADV;
+    };
+
+    //BTHome v2 encryption on top of any other options
+    //each pack gets a 4 bytes counter and a 4 bytes MIC
+    template<class Base = AdvOptions>
+    struct Encrypted: Base
+    {
+        static constexpr bool kEncrypted = true;
+    };
 
-        template<class...T>
-        constexpr size_t SumSize = 2 + 1 + (T::kDataSize + ...) + sizeof...(T);
+    //for updates coming from other threads than the advertiser:
+    //the controller is always given a consistent snapshot of a pack, never one with half-written values.
+    //Writers don't lock and never wait for the advertiser; the advertiser retries the snapshot
+    //a few times and falls back to the last consistent one if writers keep it busy.
+    template<class Base = AdvOptions>
+    struct DoubleBuffered: Base
+    {
+        static constexpr bool kDoubleBuffered = true;
+        static constexpr size_t kSnapshotRetries = 8;
+    };
 
-        template<class... T>
-        struct TypeList
+    //the name goes into the scan response (the advertising becomes scannable),
+    //so the packs get the whole payload minus the flags field
+    //legacy advertising only: extended scannable advertising can't carry advertising data
+    template<class Base = AdvOptions>
+    struct NameInScanResponse: Base
+    {
+        static constexpr bool kNameInScanResponse = true;
+        static_assert(!Base::kExtended, "Extended scannable advertising can't carry advertising data");
+    };
+
+    //BLE 5 periodic advertising: the pack is sent at a fixed interval to scanners synced to the train,
+    //updates are pushed to it right away (see BasicAdvertisement::advertise_periodic).
+    //Needs CONFIG_BT_PER_ADV.
+    template<class Base = ExtAdvOptions>
+    struct Periodic: Base
+    {
+        static constexpr bool kPeriodic = true;
+        //periodic interval, in 1.25 ms units
+        static constexpr uint16_t kPerIntMin = 800;
+        static constexpr uint16_t kPerIntMax = 800;
+        static_assert(Base::kExtended, "Periodic advertising needs extended advertising");
+        static_assert(kPerAdvAvailable || !Base::kExtended, "Periodic advertising needs CONFIG_BT_PER_ADV");
+    };
+
+    //counts updates, packs and bytes handed to the controller, failed bt_le_adv_* calls and cycle time,
+    //see BasicAdvertisement::stats(); without it none of this is compiled in
+    template<class Base = AdvOptions>
+    struct WithStats: Base
+    {
+        static constexpr bool kStats = true;
+    };
+
+    //send_event (see BasicAdvertisement::send_event); without it the burst state isn't stored
+    template<class Base = AdvOptions>
+    struct WithEvents: Base
+    {
+        static constexpr bool kEvents = true;
+    };
+
+    //for advertisements only driven by advertise()/advertise_with() or advertise_sets:
+    //the async cycle state (work item, parameters, callback) isn't stored
+    template<class Base = AdvOptions>
+    struct BlockingOnly: Base
+    {
+        static constexpr bool kAsync = false;
+    };
+
+    template<class Options, size_t NameLen, class... T> requires (IsBTHomeDataType<T> &&...)
+    struct BasicAdvertisement
+    {
+        static constexpr size_t kMaxAdvSize = Options::kMaxAdvSize;
+        //m_Data holds flags, service data and name; with Options::kNameInScanResponse the name is sent as scan response
+        static constexpr size_t kAdvPacketFields = Options::kNameInScanResponse ? 2 : 3;
+        static constexpr size_t kScanFields = 3 - kAdvPacketFields;
+        static constexpr size_t kSvcDataField = 1;
+        static constexpr size_t kNameField = 2;
+        static constexpr size_t kNameInAdv = Options::kNameInScanResponse ? 0 : NameLen - 1;
+        static constexpr size_t kEncryptionOverhead = Options::kEncrypted ? tools::Cipher::kOverhead : 0;
+        static constexpr size_t kAllowedSensorPayload = kMaxAdvSize - (1/*flags*/ + kNameInAdv + kAdvPacketFields * 2/*length byte + type byte*/) - kEncryptionOverhead;
+        static_assert(!Options::kNameInScanResponse || (NameLen - 1) + 2 <= 31, "Name doesn't fit into the scan response");
+
+        using AdvLayout = tools::Layout<kAllowedSensorPayload, T...>;
+        using AdvDataHolder = tools::AdvertisementsList<kAllowedSensorPayload, T...>;
+        //packs per advertising cycle as chosen by tools::Layout, usable in static_assert to size the duty cycle
+        static constexpr size_t kPacksCount =  AdvDataHolder::kSize;
+        static_assert(kPacksCount <= 32, "Too many packs for the dirty mask");
+        static constexpr uint32_t kAllPacksMask = kPacksCount == 32 ? ~uint32_t(0) : ((uint32_t(1) << kPacksCount) - 1);
+        static constexpr bool kSetsAvailable = kPacksCount <= kMaxAdvSets;
+
+        //Airtime and energy model (bthome_airtime.hpp) for static_assert budgets and comparing configurations.
+        //Variable length objects count with their maximum length, scan responses are not counted.
+        //advertising data bytes of pack p: flags, service data and the name unless it's in the scan response
+        static constexpr size_t adv_data_size(size_t p)
         {
-            static constexpr size_t kSize = sizeof...(T);
-        };
+            return 1/*flags*/ + kNameInAdv + kAdvPacketFields * 2/*length byte + type byte*/ + AdvLayout::pack_size(p) + kEncryptionOverhead;
+        }
+
+        //TX time of one advertising event of pack p
+        static constexpr uint32_t event_airtime_us(size_t p) { return airtime::EventUs(adv_data_size(p), Options::kExtended); }
 
-        template<size_t SizeLimit, class Results, class CurrentBatch, class... Remaining>
-        struct Packer;
+        //TX time of one advertising event of every pack
+        static constexpr uint32_t kAirtimeUs = []{
+            uint32_t us = 0;
+            for(size_t p = 0; p < kPacksCount; ++p)
+                us += event_airtime_us(p);
+            return us;
+        }();
 
-        template<size_t SizeLimit, class... Results, class... Batch>
-        struct Packer<SizeLimit, TypeList<Results...>, TypeList<Batch...>>
+        //charge of one advertise_with cycle in uC: every pack on air for slot_ms at interval_ms
+        static constexpr float cycle_charge_uc(uint32_t interval_ms, uint32_t slot_ms, const airtime::PowerProfile &profile = {})
         {
-            using type = TypeList<Results..., AdvertismentSVC<Batch...>>;
-        };
+            float uc = 0;
+            for(size_t p = 0; p < kPacksCount; ++p)
+                uc += float(airtime::EventsPerSlot(interval_ms, slot_ms)) * airtime::EventChargeUc(event_airtime_us(p), Options::kExtended, profile);
+            return uc;
+        }
 
-        template<size_t SizeLimit, class... Results>
-        struct Packer<SizeLimit, TypeList<Results...>, TypeList<>>
+        //average current in uA with such a cycle every period_ms
+        //continuous rotation (advertise_async from its own callback) is period_ms = kPacksCount * slot_ms
+        static constexpr float average_current_ua(uint32_t interval_ms, uint32_t slot_ms, uint32_t period_ms, const airtime::PowerProfile &profile = {})
         {
-            using type = TypeList<Results...>;
-        };
+            return profile.m_SleepUa + cycle_charge_uc(interval_ms, slot_ms, profile) * 1000.f / float(period_ms);
+        }
 
-        template<size_t SizeLimit, class... Results, class T, class... Batch, class... Rest>
-        struct Packer<SizeLimit, TypeList<Results...>, TypeList<Batch...>, T, Rest...>
+        //datas are the initial values, in declaration order, or nothing for the defaults.
+        //Constant evaluated, so an advertisement can be constinit: it's then part of the
+        //initialized data image and no constructor runs at boot.
+        template<size_t N, class... S>
+        constexpr BasicAdvertisement(const char (&name)[N], Flags f, S... datas):
+            m_SensorData{Options::kEncrypted ? (f | Flags::Encryption) : f},
+            m_Data{
+                BT_DATA(BT_DATA_FLAGS, &g_Flags, 1),
+                BT_DATA(BT_DATA_SVC_DATA16, nullptr, 0),
+                BT_DATA(BT_DATA_NAME_COMPLETE, nullptr, N - 1),//bound on first use, see bind_name
+            },
+            m_pName(name)
         {
-            static_assert(SumSize<T> <= SizeLimit, "Data type is too big");
-            using type = std::conditional_t<
-                SumSize<T, Batch...> <= SizeLimit
-                , typename Packer<SizeLimit, TypeList<Results...>, TypeList<Batch..., T>, Rest...>::type
-                , typename Packer<SizeLimit, TypeList<Results..., AdvertismentSVC<Batch...>>, TypeList<T>, Rest...>::type
-                >;
-        };
+            static_assert(sizeof...(S) == 0 || std::is_same_v<tools::TypeList<S...>, tools::TypeList<T...>>, "Initial values must be given for all the types, in declaration order");
+            if constexpr (sizeof...(S) > 0)
+                init_values(std::index_sequence_for<S...>{}, datas...);
+            if constexpr (Options::kDoubleBuffered)
+            {
+                for(size_t i = 0; i < kPacksCount; ++i)
+                    m_SensorData.visit(i, [&](auto &d){ copy_pack(d, m_Buf.m_Front[i]); });
+            }
+        }
 
-        template<size_t Idx>
-        struct index_tag_t{
-            static constexpr size_t kIdx = Idx;
-        };
+        //returns true if the encoded value changed; only then the pack is marked dirty
+        template<class X, class Value>
+        bool update(Value v)
+        {
+            return update_nth<X, 0, Value>(v);
+        }
 
-        template<size_t Idx, class T>
-        struct IndexedBase: T
+        //Nth is 0-based and counts in declaration order: update_nth<X, 1> updates the second X
+        //regardless of the pack it ended up in
+        template<class X, size_t Nth, class Value>
+        bool update_nth(Value v)
         {
-            using T::T;
-            constexpr T& get(index_tag_t<Idx>) { return *this; }
-        };
+            constexpr size_t kIdx = tools::FindNth<X, Nth, T...>();
+            static_assert(kIdx != tools::kNotFound, "Data type not found");
+            if constexpr (kIdx != tools::kNotFound)
+            {
+                constexpr tools::ObjectLocation kLoc = AdvLayout::kLocations[kIdx];
+                auto &d = m_SensorData.get(tools::index_tag_t<kLoc.m_Pack>{});
+                if constexpr (Options::kStats)
+                    atomic_inc(&m_Stats.m_Updates[kIdx]);
+                begin_write();
+                const bool changed = d.template write<X>(v, d.m_SVCData + kLoc.m_Offset + 1);
+                if (changed)
+                    mark_changed(kLoc.m_Pack);
+                end_write();
+                if constexpr (Options::kPeriodic)
+                {
+                    if (changed && atomic_get(&m_Per.m_Running))
+                        k_work_submit(&m_Per.m_Refresh);
+                }
+                return changed;
+            }
+            return false;
+        }
+
+        //Options::kDoubleBuffered: all updates made by f are published together,
+        //the advertiser never picks up only a part of them
+        template<class F>
+        void batch(F &&f)
+        {
+            begin_write();
+            f();
+            end_write();
+        }
 
-        template<class Indexes, class Types>
-        struct MakeIndexedTypes;
+        using OptionsType = Options;
 
-        template<size_t... Idx, class... Types>
-        struct MakeIndexedTypes<std::index_sequence<Idx...>, TypeList<Types...>>
+        template<size_t I>
+        using ObjectType = tools::NthType<I, T...>;
+
+        //declaration index of the Nth X
+        template<class X, size_t Nth = 0>
+        static constexpr size_t kIndexOf = tools::FindNth<X, Nth, T...>();
+
+        //encoded bytes of the I-th object (declaration order), without the object id
+        template<size_t I>
+        const uint8_t* encoded_value()
         {
-            using type = TypeList<IndexedBase<Idx, Types>...>;
-        };
+            constexpr tools::ObjectLocation kLoc = AdvLayout::kLocations[I];
+            return m_SensorData.get(tools::index_tag_t<kLoc.m_Pack>{}).m_SVCData + kLoc.m_Offset + 1;
+        }
 
-        template<class... AdvTypes>
-        struct AdvertisementsListT: AdvTypes...
+        //integer path for FloatData types: v is in units of X::kFactor, e.g. update_scaled<Temperature>(-550) is -5.50
+        template<class X>
+        bool update_scaled(int32_t v)
         {
-            static constexpr size_t kSize = sizeof...(AdvTypes);
-            using AdvTypes::get...;
+            return update_nth<X, 0>(Scaled{v});
+        }
 
-            constexpr AdvertisementsListT(Flags f):AdvTypes{f}...
-            {}
-        };
+        template<class X, size_t Nth>
+        bool update_scaled_nth(int32_t v)
+        {
+            return update_nth<X, Nth>(Scaled{v});
+        }
+
+        //a pack is dirty if it changed since it was last handed to the controller
+        bool is_pack_dirty(size_t idx) const { return dirty_packs() & (uint32_t(1) << idx); }
+        uint32_t dirty_packs() const { return uint32_t(atomic_get(&m_DirtyPacks)); }
 
-        template<class AdvList>
-        struct MakeAdvertisementList;
+        //Options::kEncrypted only
+        //the key schedule is expanded here once, not per advertisement
+        void set_encryption_key(const uint8_t (&key)[16])
+        {
+            static_assert(Options::kEncrypted, "Encryption is not enabled in Options");
+            m_Enc.m_Cipher.m_Aes = tools::Aes128(key);
+            mark_changed_all();
+        }
 
-        template<class... AdvTypes>
-        struct MakeAdvertisementList<TypeList<AdvTypes...>>
+        //the address the advertisements are sent from (identity address with BT_LE_ADV_OPT_USE_IDENTITY)
+        void set_encryption_mac(const bt_addr_le_t &addr)
         {
-            using type = AdvertisementsListT<AdvTypes...>;
+            static_assert(Options::kEncrypted, "Encryption is not enabled in Options");
+            //bt_addr_le_t keeps the address little-endian, the nonce wants it as printed
+            uint8_t mac[6];
+            for(size_t i = 0; i < 6; ++i)
+                mac[i] = addr.a.val[5 - i];
+            m_Enc.m_Cipher.set_mac(mac);
+            mark_changed_all();
+        }
+
+        //receivers reject replayed counters, so restore the last used value after a reboot
+        void set_encryption_counter(uint32_t counter)
+        {
+            static_assert(Options::kEncrypted, "Encryption is not enabled in Options");
+            m_Enc.m_Counter = counter;
+        }
+
+        uint32_t get_encryption_counter() const
+        {
+            static_assert(Options::kEncrypted, "Encryption is not enabled in Options");
+            return m_Enc.m_Counter;
+        }
+
+        //Options::kStats only
+        struct Stats
+        {
+            uint32_t m_Updates[AdvLayout::kObjects];//update calls per object, declaration order
+            uint32_t m_Packs;//packs handed to the controller
+            uint32_t m_Bytes;//advertising data bytes handed to the controller (not counting repetitions on air)
+            uint32_t m_Errors;//failed bt_le_adv_* and bt_le_ext_adv_* calls
+            int m_LastError;
+            uint32_t m_Cycles;//completed advertise_with and async cycles
+            uint32_t m_CycleMs;//time spent in them
         };
 
-        template<size_t SizeLimit, class... DataTypes>
-        using PackedAdvertisementsList = Packer<SizeLimit, TypeList<>, TypeList<>, DataTypes...>::type;
+        //called after every completed cycle, e.g. to LOG_INF the counters or emit a tracing event
+        using stats_hook_t = void(*)(const Stats &stats, void *pCtx);
+
+        //counters are 32 bit and wrap around
+        Stats stats() const
+        {
+            static_assert(Options::kStats, "Stats are not enabled in Options");
+            Stats s;
+            for(size_t i = 0; i < AdvLayout::kObjects; ++i)
+                s.m_Updates[i] = uint32_t(atomic_get(&m_Stats.m_Updates[i]));
+            s.m_Packs = uint32_t(atomic_get(&m_Stats.m_Packs));
+            s.m_Bytes = uint32_t(atomic_get(&m_Stats.m_Bytes));
+            s.m_Errors = uint32_t(atomic_get(&m_Stats.m_Errors));
+            s.m_LastError = int(atomic_get(&m_Stats.m_LastError));
+            s.m_Cycles = uint32_t(atomic_get(&m_Stats.m_Cycles));
+            s.m_CycleMs = uint32_t(atomic_get(&m_Stats.m_CycleMs));
+            return s;
+        }
+
+        void reset_stats()
+        {
+            static_assert(Options::kStats, "Stats are not enabled in Options");
+            for(auto &u : m_Stats.m_Updates)
+                atomic_clear(&u);
+            atomic_clear(&m_Stats.m_Packs);
+            atomic_clear(&m_Stats.m_Bytes);
+            atomic_clear(&m_Stats.m_Errors);
+            atomic_clear(&m_Stats.m_LastError);
+            atomic_clear(&m_Stats.m_Cycles);
+            atomic_clear(&m_Stats.m_CycleMs);
+        }
+
+        void set_stats_hook(stats_hook_t hook, void *pCtx = nullptr)
+        {
+            static_assert(Options::kStats, "Stats are not enabled in Options");
+            m_Stats.m_pHook = hook;
+            m_Stats.m_pHookCtx = pCtx;
+        }
+
+        int advertise()
+        {
+            const struct bt_le_adv_param adv_param[] = {
+                BT_LE_ADV_PARAM_INIT(Options::kDefaultAdvOpt, BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, nullptr) 
+            };
+            return advertise_with(adv_param, 1500);
+        }
+
+        //clean_duration_ms is the slot for packs that are not dirty:
+        //<0 - same as adv_duration_ms, 0 - clean packs are skipped altogether
+        //Returns the error if advertising couldn't be started, the cycle is cut short then.
+        //A pack the controller didn't take stays dirty and is sent again by the next cycle.
+        int advertise_with(const bt_le_adv_param *adv_param, int adv_duration_ms, int clean_duration_ms = -1)
+        {
+            const int64_t begin = cycle_begin();
+            bool started = false;
+            int err = 0;
+            for(size_t i = 0; i < kPacksCount; ++i)
+            {
+                int slot = pack_slot(i, adv_duration_ms, clean_duration_ms);
+                if (!slot)
+                    continue;
+
+                err = push_pack(i, started, adv_param);
+                if (!started && err)
+                    break;
+                started = true;
+                k_sleep(K_MSEC(slot));
+            }
+
+            if (started)
+                adv_stop();
+            cycle_end(begin);
+            return started ? 0 : err;
+        }
+
+        //only the packs that changed since the last cycle
+        int advertise_changed()
+        {
+            const struct bt_le_adv_param adv_param[] = {
+                BT_LE_ADV_PARAM_INIT(Options::kDefaultAdvOpt, BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, nullptr) 
+            };
+            return advertise_with(adv_param, 1500, 0);
+        }
+
+        //called from the system work queue once the last pack was advertised
+        using done_callback_t = void(*)(void *pCtx);
+
+        void advertise_async(done_callback_t cb = nullptr, void *pCtx = nullptr)
+        {
+            const struct bt_le_adv_param adv_param[] = {
+                BT_LE_ADV_PARAM_INIT(Options::kDefaultAdvOpt, BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, nullptr) 
+            };
+            advertise_with_async(adv_param, 1500, cb, pCtx);
+        }
+
+        //Same sequence as advertise_with but driven by a delayable work item:
+        //returns immediately, packs are rotated every adv_duration_ms.
+        //Calling it while a cycle is running restarts the cycle from the first pack.
+        //It's fine to call it from the completion callback to loop.
+        //If advertising can't be started the cycle ends there: the callback is still called
+        //and async_error() returns the error.
+        void advertise_with_async(const bt_le_adv_param *adv_param, int adv_duration_ms, done_callback_t cb = nullptr, void *pCtx = nullptr, int clean_duration_ms = -1)
+        {
+            static_assert(Options::kAsync, "Async advertising is disabled in Options");
+            if (!m_Async.m_pSelf)
+            {
+                k_work_init_delayable(&m_Async.m_Work, &on_async_work);
+                m_Async.m_pSelf = this;
+            }
+
+            if (m_Async.m_Running)
+                cancel();
+
+            m_Async.m_Param = *adv_param;
+            m_Async.m_DurationMs = adv_duration_ms;
+            m_Async.m_CleanDurationMs = clean_duration_ms;
+            m_Async.m_pDone = cb;
+            m_Async.m_pCtx = pCtx;
+            m_Async.m_NextPack = 0;
+            m_Async.m_Err = 0;
+            m_Async.m_Started = false;
+            m_Async.m_Running = true;
+            if constexpr (Options::kStats)
+                m_Stats.m_AsyncBegin = cycle_begin();
+            k_work_schedule(&m_Async.m_Work, K_NO_WAIT);
+        }
+
+        //stops the running async cycle without invoking the completion callback
+        //must not be called from the completion callback
+        void cancel()
+        {
+            if constexpr (Options::kAsync)
+            {
+                if (!m_Async.m_Running)
+                    return;
+
+                k_work_sync sync;
+                k_work_cancel_delayable_sync(&m_Async.m_Work, &sync);
+                if (m_Async.m_Started)
+                    adv_stop();
+                m_Async.m_Running = false;
+            }
+        }
 
-        template<class Packed>
-        using AdvertisementsListFromPacked = MakeAdvertisementList<typename MakeIndexedTypes<decltype(std::make_index_sequence<Packed::kSize>()), Packed>::type>::type;
+        bool is_advertising() const
+        {
+            if constexpr (Options::kAsync)
+                return m_Async.m_Running;
+            else
+                return false;
+        }
 
-        template<size_t SizeLimit, class... DataTypes>
-        using AdvertisementsList = AdvertisementsListFromPacked<PackedAdvertisementsList<SizeLimit, DataTypes...>>;
+        //error that ended the last async cycle early, 0 if it went through
+        int async_error() const
+        {
+            if constexpr (Options::kAsync)
+                return m_Async.m_Err;
+            else
+                return 0;
+        }
 
-        template<size_t CurrentSize, class DataType>
-        constexpr size_t DataTypeSizeWith = (CurrentSize == 0) ? SumSize<DataType> : CurrentSize + DataSizeOf<DataType>;
+        //Every pack in its own advertising set, all of them on air at the same time: a receiver sees
+        //the whole state within one interval instead of kPacksCount slots.
+        //The intervals of the sets are staggered by Options::kSetIntervalStagger so they don't keep colliding.
+        //Needs CONFIG_BT_EXT_ADV with CONFIG_BT_EXT_ADV_MAX_ADV_SET >= kPacksCount; without it, or if the
+        //controller can't provide the sets, falls back to advertise_with_async (unless Options is BlockingOnly)
+        //and returns false.
+        //Call refresh_sets after updates to push the changed packs.
+        bool advertise_sets(const bt_le_adv_param *adv_param, int fallback_duration_ms = 1500)
+        {
+            if constexpr (kSetsAvailable)
+            {
+                if (!start_sets(adv_param))
+                    return true;
+                stop_sets(true);
+            }
+            if constexpr (Options::kAsync)
+                advertise_with_async(adv_param, fallback_duration_ms);
+            return false;
+        }
 
-        template<size_t SizeLimit
-            , size_t AdvIdx
-            , size_t AdvDataOffset
-            , size_t AdvSize
-            , size_t DataIdx
-            , class X, class... DataTypes>
-        struct FindAdvIndexForType;
+        //pushes the packs updated since the last call to their sets
+        void refresh_sets()
+        {
+            if constexpr (kSetsAvailable)
+            {
+                if (!m_SetsRunning)
+                    return;
+                for(size_t i = 0; i < kPacksCount; ++i)
+                {
+                    if (!is_pack_dirty(i))
+                        continue;
+                    set_pack_data(i);
+                    if (!keep_dirty_on_error(i, tracked(bt_le_ext_adv_set_data(m_pSets[i], m_Data, kAdvPacketFields, scan_data(), kScanFields))))
+                        count_sent();
+                }
+            }
+        }
 
-        template<size_t SizeLimit
-            , size_t AdvIdx
-            , size_t AdvDataOffset
-            , size_t AdvSize
-            , class X, class... DataTypes>
-        struct FindAdvIndexForType<SizeLimit, AdvIdx, AdvDataOffset, AdvSize, 1, X, X, DataTypes...>
+        //delete_sets gives the sets back to the stack, otherwise they're kept for the next advertise_sets
+        void stop_sets(bool delete_sets = false)
         {
-            //found
-            static constexpr size_t kNextAdvIndex = (DataTypeSizeWith<AdvSize, X> <= SizeLimit) ? AdvIdx : AdvIdx + 1;
+            if constexpr (kSetsAvailable)
+            {
+                for(auto *&pSet : m_pSets)
+                {
+                    if (!pSet)
+                        continue;
+                    tracked(bt_le_ext_adv_stop(pSet));
+                    if (delete_sets)
+                    {
+                        tracked(bt_le_ext_adv_delete(pSet));
+                        pSet = nullptr;
+                    }
+                }
+                m_SetsRunning = false;
+            }
+        }
+
+        bool sets_running() const { return m_SetsRunning; }
 
-            //resulting data
-            static constexpr size_t kAdvertismentIndex = kNextAdvIndex;
-            static constexpr size_t kAdvertismentDataOffset = AdvDataOffset;
-            static constexpr bool kFound = true;
+        //Options::kPeriodic only. Starts the extended advertising that carries the sync info (flags and name)
+        //and the periodic train with the pack. Every update that changes the pack is pushed to the train
+        //from the system work queue, so synced scanners get it within one periodic interval.
+        //adv_param: null for Options::kDefaultAdvOpt at the slow interval; must be non-connectable and non-scannable.
+        //Not to be mixed with the other advertise calls.
+        int advertise_periodic(const bt_le_adv_param *adv_param = nullptr)
+        {
+            static_assert(Options::kPeriodic, "Periodic advertising is not enabled in Options");
+            static_assert(kPacksCount == 1, "Periodic advertising carries a single pack");
+            if (!m_Per.m_pSelf)
+            {
+                k_work_init(&m_Per.m_Refresh, &on_periodic_refresh);
+                m_Per.m_pSelf = this;
+            }
+
+            const bt_le_adv_param defParam = BT_LE_ADV_PARAM_INIT(Options::kDefaultAdvOpt, BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, nullptr);
+            const bt_le_per_adv_param perParam = BT_LE_PER_ADV_PARAM_INIT(Options::kPerIntMin, Options::kPerIntMax, 0);
+            int err = tracked(m_pExtAdv ? bt_le_ext_adv_update_param(m_pExtAdv, adv_param ? adv_param : &defParam) : bt_le_ext_adv_create(adv_param ? adv_param : &defParam, nullptr, &m_pExtAdv));
+            if (err)
+                return err;
+            if ((err = tracked(bt_le_per_adv_set_param(m_pExtAdv, &perParam))))
+                return err;
+
+            //flags aren't allowed in periodic advertising data, they stay with the name
+            set_pack_data(0);
+            const bt_data syncInfo[] = {m_Data[0], m_Data[kNameField]};
+            if ((err = keep_dirty_on_error(0, tracked(bt_le_ext_adv_set_data(m_pExtAdv, syncInfo, 2, nullptr, 0)))))
+                return err;
+            if ((err = keep_dirty_on_error(0, tracked(bt_le_per_adv_set_data(m_pExtAdv, &m_Data[kSvcDataField], 1)))))
+                return err;
+            count_sent();
+            if ((err = tracked(bt_le_per_adv_start(m_pExtAdv))))
+                return err;
+            static const bt_le_ext_adv_start_param kStart = BT_LE_EXT_ADV_START_PARAM_INIT(0, 0);
+            if ((err = tracked(bt_le_ext_adv_start(m_pExtAdv, &kStart))))
+            {
+                bt_le_per_adv_stop(m_pExtAdv);
+                return err;
+            }
+            atomic_set(&m_Per.m_Running, 1);
+            //an update may have come in before m_Running was set
+            k_work_submit(&m_Per.m_Refresh);
+            return 0;
+        }
+
+        void stop_periodic()
+        {
+            static_assert(Options::kPeriodic, "Periodic advertising is not enabled in Options");
+            if (!atomic_clear(&m_Per.m_Running))
+                return;
+            k_work_sync sync;
+            k_work_cancel_sync(&m_Per.m_Refresh, &sync);
+            tracked(bt_le_per_adv_stop(m_pExtAdv));
+            tracked(bt_le_ext_adv_stop(m_pExtAdv));
+        }
+
+        bool periodic_running() const
+        {
+            if constexpr (Options::kPeriodic)
+                return atomic_get(&m_Per.m_Running);
+            else
+                return false;
+        }
+
+        //Low level, for schedulers interleaving several advertisements (see bthome_bridge.hpp):
+        //pack idx stays on air with adv_param until stop_pack().
+        //Not to be mixed with the other advertise calls.
+        int start_pack(size_t idx, const bt_le_adv_param *adv_param)
+        {
+            return push_pack(idx, false, adv_param);
+        }
+
+        int stop_pack() { return adv_stop(); }
+
+        //Sends X right away in a pack of its own, together with a fresh PacketId and Flags::Trigger,
+        //at the fast interval for burst_duration_ms. A running async cycle is interrupted and resumes
+        //afterwards with the pack it was on. Events aren't queued: a new one replaces the one being sent.
+        //Can be called from any thread or ISR, the burst runs on the system work queue.
+        //Not to be mixed with the blocking advertise()/advertise_with(). Needs WithEvents in Options.
+        template<class X, class Value>
+        void send_event(Value v, int burst_duration_ms = Options::kEventBurstMs)
+        {
+            static_assert(Options::kEvents, "Events are not enabled in Options");
+            static_assert(!kIsVariable<X>, "Events carry fixed size objects only");
+            using EventPack = AdvertismentSVC<PacketId, X>;
+            static_assert(EventPack::kSVCDataSize <= kAllowedSensorPayload, "Event doesn't fit into a pack");
+
+            k_spinlock_key_t key = k_spin_lock(&m_Event.m_Lock);
+            if (!m_Event.m_pSelf)
+            {
+                k_work_init(&m_Event.m_Start, &on_event_start);
+                k_work_init_delayable(&m_Event.m_End, &on_event_end);
+                m_Event.m_pSelf = this;
+            }
+            EventPack pack(Flags::None, PacketId(m_Event.m_NextPacketId++), X(v));
+            //same header as the regular packs, plus the trigger flag
+            pack.m_SVCData[2] = m_SensorData.get(tools::index_tag_t<0>{}).m_SVCData[2] | uint8_t(Flags::Trigger);
+            for(size_t i = 0; i < pack.kSVCDataSize; ++i)
+                m_Event.m_Pending[i] = pack.m_SVCData[i];
+            m_Event.m_PendingSize = pack.size();
+            m_Event.m_DurationMs = burst_duration_ms;
+            k_spin_unlock(&m_Event.m_Lock, key);
+
+            k_work_submit(&m_Event.m_Start);
+        }
+
+    private:
+        int adv_start(const bt_le_adv_param *adv_param)
+        {
+            const int err = tracked(adv_start_impl(adv_param));
+            if (!err)
+                count_sent();
+            return err;
+        }
+
+        int adv_update()
+        {
+            const int err = tracked(adv_update_impl());
+            if (!err)
+                count_sent();
+            return err;
+        }
+
+        int adv_stop()
+        {
+            return tracked(adv_stop_impl());
+        }
+
+        int adv_start_impl(const bt_le_adv_param *adv_param)
+        {
+            if constexpr (Options::kExtended)
+            {
+                //the set is created once and reused; parameters may only change while it's stopped
+                int err = m_pExtAdv ? bt_le_ext_adv_update_param(m_pExtAdv, adv_param) : bt_le_ext_adv_create(adv_param, nullptr, &m_pExtAdv);
+                if (err)
+                    return err;
+                if ((err = bt_le_ext_adv_set_data(m_pExtAdv, m_Data, kAdvPacketFields, nullptr, 0)))
+                    return err;
+                //BT_LE_EXT_ADV_START_DEFAULT is a C compound literal, C++ can't take its address
+                static const bt_le_ext_adv_start_param kStart = BT_LE_EXT_ADV_START_PARAM_INIT(0, 0);
+                return bt_le_ext_adv_start(m_pExtAdv, &kStart);
+            }
+            else
+            {
+                const bt_le_adv_param param = scannable(*adv_param);
+                return bt_le_adv_start(&param, m_Data, kAdvPacketFields, scan_data(), kScanFields);
+            }
+        }
+
+        int adv_update_impl()
+        {
+            if constexpr (Options::kExtended)
+                return bt_le_ext_adv_set_data(m_pExtAdv, m_Data, kAdvPacketFields, nullptr, 0);
+            else
+                return bt_le_adv_update_data(m_Data, kAdvPacketFields, scan_data(), kScanFields);
+        }
+
+        const bt_data* scan_data() const { return kScanFields ? m_Data + kAdvPacketFields : nullptr; }
+
+        static bt_le_adv_param scannable(bt_le_adv_param param)
+        {
+            if constexpr (Options::kNameInScanResponse)
+                param.options |= BT_LE_ADV_OPT_SCANNABLE;
+            return param;
+        }
+
+        int adv_stop_impl()
+        {
+            if constexpr (Options::kExtended)
+                return bt_le_ext_adv_stop(m_pExtAdv);
+            else
+                return bt_le_adv_stop();
+        }
+
+        //hands pack idx over: starts advertising with it or replaces the data on air
+        int push_pack(size_t idx, bool started, const bt_le_adv_param *adv_param)
+        {
+            set_pack_data(idx);
+            return keep_dirty_on_error(idx, started ? adv_update() : adv_start(adv_param));
+        }
+
+        //set_pack_data cleared the dirty bit, but the controller didn't take the pack: it's sent again later
+        int keep_dirty_on_error(size_t idx, int err)
+        {
+            if (err)
+                mark_changed(idx);
+            return err;
+        }
+
+        int start_sets(const bt_le_adv_param *adv_param)
+        {
+            static const bt_le_ext_adv_start_param kStart = BT_LE_EXT_ADV_START_PARAM_INIT(0, 0);
+            for(size_t i = 0; i < kPacksCount; ++i)
+            {
+                bt_le_adv_param param = scannable(*adv_param);
+                param.interval_min += i * Options::kSetIntervalStagger;
+                param.interval_max += i * Options::kSetIntervalStagger;
+                auto *&pSet = m_pSets[i];
+                int err = tracked(pSet ? bt_le_ext_adv_update_param(pSet, &param) : bt_le_ext_adv_create(&param, nullptr, &pSet));
+                if (err)
+                    return err;
+                set_pack_data(i);
+                if ((err = keep_dirty_on_error(i, tracked(bt_le_ext_adv_set_data(pSet, m_Data, kAdvPacketFields, scan_data(), kScanFields)))))
+                    return err;
+                if ((err = tracked(bt_le_ext_adv_start(pSet, &kStart))))
+                    return err;
+                count_sent();
+            }
+            m_SetsRunning = true;
+            return 0;
+        }
+
+        int pack_slot(size_t idx, int adv_duration_ms, int clean_duration_ms) const
+        {
+            if (clean_duration_ms < 0 || is_pack_dirty(idx))
+                return adv_duration_ms;
+            return clean_duration_ms;
+        }
+
+        //Options::kStats bookkeeping, compiles to nothing without it
+        int tracked(int err)
+        {
+            if constexpr (Options::kStats)
+            {
+                if (err)
+                {
+                    atomic_inc(&m_Stats.m_Errors);
+                    atomic_set(&m_Stats.m_LastError, atomic_val_t(err));
+                }
+            }
+            return err;
+        }
+
+        //m_Data was handed to the controller
+        void count_sent()
+        {
+            if constexpr (Options::kStats)
+            {
+                size_t bytes = 0;
+                for(size_t i = 0; i < kAdvPacketFields; ++i)
+                    bytes += 2/*length byte + type byte*/ + m_Data[i].data_len;
+                atomic_inc(&m_Stats.m_Packs);
+                atomic_add(&m_Stats.m_Bytes, atomic_val_t(bytes));
+            }
+        }
+
+        static int64_t cycle_begin()
+        {
+            if constexpr (Options::kStats)
+                return k_uptime_get();
+            else
+                return 0;
+        }
+
+        void cycle_end(int64_t begin)
+        {
+            if constexpr (Options::kStats)
+            {
+                atomic_inc(&m_Stats.m_Cycles);
+                atomic_add(&m_Stats.m_CycleMs, atomic_val_t(k_uptime_get() - begin));
+                if (m_Stats.m_pHook)
+                    m_Stats.m_pHook(stats(), m_Stats.m_pHookCtx);
+            }
+        }
+
+        template<size_t... I, class... S>
+        constexpr void init_values(std::index_sequence<I...>, const S&... datas)
+        {
+            (datas.fill(m_SensorData.get(tools::index_tag_t<AdvLayout::kLocations[I].m_Pack>{}).m_SVCData + AdvLayout::kLocations[I].m_Offset), ...);
+        }
+
+        //a char pointer can't become bt_data's uint8_t pointer in a constant expression,
+        //so the name field is bound before m_Data is first handed over; the name stays in flash
+        void bind_name()
+        {
+            m_Data[kNameField].data = reinterpret_cast<const uint8_t*>(m_pName);
+        }
+
+        //points the service data field at the pack and clears its dirty bit
+        void set_pack_data(size_t idx)
+        {
+            bind_name();
+            bool dirty = atomic_and(&m_DirtyPacks, ~atomic_val_t(uint32_t(1) << idx)) & atomic_val_t(uint32_t(1) << idx);
+            m_SensorData.visit(idx, [&](auto &d){
+                const uint8_t *pPlain = d.m_SVCData;
+                if constexpr (Options::kDoubleBuffered)
+                {
+                    if (dirty && !snapshot(d, m_Buf.m_Front[idx]))
+                    {
+                        //keep sending the last consistent snapshot, retry on the next cycle
+                        mark_changed(idx);
+                        dirty = false;
+                    }
+                    pPlain = m_Buf.m_Front[idx];
+                }
+
+                if constexpr (Options::kEncrypted)
+                {
+                    //ciphertext is only recomputed (with a fresh counter) if the pack was updated
+                    auto &p = m_Enc.m_Packs[idx];
+                    if (dirty)
+                    {
+                        p.m_Size = uint8_t(d.used_size(pPlain) + kEncryptionOverhead);
+                        m_Enc.m_Cipher.encrypt(pPlain, p.m_Size - kEncryptionOverhead, m_Enc.m_Counter++, p.m_Data);
+                    }
+                    m_Data[kSvcDataField].data = p.m_Data;
+                    m_Data[kSvcDataField].data_len = p.m_Size;
+                }
+                else
+                {
+                    m_Data[kSvcDataField].data = pPlain;
+                    m_Data[kSvcDataField].data_len = d.used_size(pPlain);
+                }
+            });
+        }
+
+        void mark_changed(size_t idx) { atomic_or(&m_DirtyPacks, atomic_val_t(uint32_t(1) << idx)); }
+        void mark_changed_all() { atomic_set(&m_DirtyPacks, atomic_val_t(kAllPacksMask)); }
+
+        //writers only bump counters, the advertiser checks them around its copy (seqlock with many writers)
+        void begin_write()
+        {
+            if constexpr (Options::kDoubleBuffered)
+                atomic_inc(&m_Buf.m_WritesBegun);
+        }
+
+        void end_write()
+        {
+            if constexpr (Options::kDoubleBuffered)
+                atomic_inc(&m_Buf.m_WritesDone);
+        }
+
+        template<class Pack>
+        static constexpr void copy_pack(const Pack &d, uint8_t *pDst)
+        {
+            for(size_t i = 0; i < d.kSVCDataSize; ++i)
+                pDst[i] = d.m_SVCData[i];
+        }
+
+        //the copy is consistent if no write was in flight before or during it
+        template<class Pack>
+        bool snapshot(const Pack &d, uint8_t *pDst)
+        {
+            for(size_t attempt = 0; attempt < Options::kSnapshotRetries; ++attempt)
+            {
+                const atomic_val_t done = atomic_get(&m_Buf.m_WritesDone);
+                if (atomic_get(&m_Buf.m_WritesBegun) != done)
+                    continue;
+                copy_pack(d, m_Buf.m_Back);
+                barrier_dmem_fence_full();//the copy must be complete before the counter is checked again
+                if (atomic_get(&m_Buf.m_WritesBegun) != done)
+                    continue;
+                for(size_t i = 0; i < d.kSVCDataSize; ++i)
+                    pDst[i] = m_Buf.m_Back[i];
+                return true;
+            }
+            return false;
+        }
+
+        struct EncryptedPack
+        {
+            uint8_t m_Data[kAllowedSensorPayload + kEncryptionOverhead];
+            uint8_t m_Size = 0;//of the ciphertext in m_Data
         };
 
-        template<size_t SizeLimit
-            , size_t AdvIdx
-            , size_t AdvDataOffset
-            , size_t AdvSize
-            , size_t DataIdx
-            , class X>
-        struct FindAdvIndexForType<SizeLimit, AdvIdx, AdvDataOffset, AdvSize, DataIdx, X>
-        {
-            //didn't find anything
-            //resulting data
-            static constexpr size_t kAdvertismentIndex = 0xff;
-            static constexpr size_t kAdvertismentDataOffset = 0xff;
-            static constexpr bool kFound = false;
+        struct EncryptionState
+        {
+            tools::Cipher m_Cipher;
+            uint32_t m_Counter = 0;
+            EncryptedPack m_Packs[kPacksCount];
         };
 
-        template<size_t SizeLimit
-            , size_t AdvIdx
-            , size_t AdvDataOffset
-            , size_t AdvSize
-            , size_t DataIdx
-            , class X, class... DataTypes>
-        struct FindAdvIndexForType<SizeLimit, AdvIdx, AdvDataOffset, AdvSize, DataIdx, X, X, DataTypes...>
-        {
-            //found some X but not our idx
-            //helping data/types
-            static constexpr size_t kNextAdvIndex = (DataTypeSizeWith<AdvSize, X> <= SizeLimit) ? AdvIdx : AdvIdx + 1;
-            static constexpr size_t kNextAdvSize = DataTypeSizeWith<AdvSize, X> <= SizeLimit ? DataTypeSizeWith<AdvSize, X> : DataTypeSizeWith<0, X>;
-            using next_type_t = FindAdvIndexForType<SizeLimit, kNextAdvIndex, AdvDataOffset + 1, kNextAdvSize, DataIdx - 1, X, DataTypes...>;
-
-            //resulting data
-            static constexpr size_t kAdvertismentIndex = next_type_t::kAdvertismentIndex;
-            static constexpr size_t kAdvertismentDataOffset = next_type_t::kAdvertismentDataOffset;
-            static constexpr bool kFound = next_type_t::kFound;
+        struct BufferState
+        {
+            atomic_t m_WritesBegun = ATOMIC_INIT(0);
+            atomic_t m_WritesDone = ATOMIC_INIT(0);
+            uint8_t m_Back[kAllowedSensorPayload];//scratch copy, the front one is only replaced once it's known to be consistent
+            uint8_t m_Front[kPacksCount][kAllowedSensorPayload];
         };
 
-        template<size_t SizeLimit
-            , size_t AdvIdx
-            , size_t AdvDataOffset
-            , size_t AdvSize
-            , size_t DataIdx
-            , class X, class Y, class... DataTypes>
-        struct FindAdvIndexForType<SizeLimit, AdvIdx, AdvDataOffset, AdvSize, DataIdx, X, Y, DataTypes...>
-        {
-            //not our type
-            //helping data/types
-            static constexpr size_t kNextAdvIndex = (DataTypeSizeWith<AdvSize, Y> <= SizeLimit) ? AdvIdx : AdvIdx + 1;
-            static constexpr size_t kNextAdvSize = DataTypeSizeWith<AdvSize, Y> <= SizeLimit ? DataTypeSizeWith<AdvSize, Y> : DataTypeSizeWith<0, Y>;
-            using next_type_t = FindAdvIndexForType<SizeLimit, kNextAdvIndex, AdvDataOffset, kNextAdvSize, DataIdx, X, DataTypes...>;
-
-            //resulting data
-            static constexpr size_t kAdvertismentIndex = next_type_t::kAdvertismentIndex;
-            static constexpr size_t kAdvertismentDataOffset = next_type_t::kAdvertismentDataOffset;
-            static constexpr bool kFound = next_type_t::kFound;
+        struct EventState
+        {
+            k_work m_Start;
+            k_work_delayable m_End;
+            k_spinlock m_Lock;//guards m_Pending* and m_DurationMs, written by send_event callers
+            BasicAdvertisement *m_pSelf = nullptr;
+            uint8_t m_Pending[kAllowedSensorPayload];
+            size_t m_PendingSize = 0;
+            int m_DurationMs = 0;
+            uint8_t m_NextPacketId = 0;
+            //the rest is only touched from the work queue
+            uint8_t m_Plain[kAllowedSensorPayload];
+            uint8_t m_Encrypted[Options::kEncrypted ? kAllowedSensorPayload + kEncryptionOverhead : 1];
+            bool m_Bursting = false;
+            bool m_Resume = false;//an async cycle was interrupted
         };
 
+        struct PeriodicState
+        {
+            k_work m_Refresh;
+            BasicAdvertisement *m_pSelf = nullptr;
+            atomic_t m_Running = ATOMIC_INIT(0);
+        };
 
-        template<size_t SizeLimit, class Needle, class... Haystack>
-        using FindDataTypeInAdvListT = FindAdvIndexForType<SizeLimit, 0, 0, 0, 1, Needle, Haystack...>;
+        static void on_periodic_refresh(k_work *pWork)
+        {
+            CONTAINER_OF(pWork, PeriodicState, m_Refresh)->m_pSelf->periodic_refresh();
+        }
 
-        template<size_t SizeLimit, size_t Nth, class Needle, class... Haystack>
-        using FindNthDataTypeInAdvListT = FindAdvIndexForType<SizeLimit, 0, 0, 0, 1 + Nth, Needle, Haystack...>;
-    }
+        void periodic_refresh()
+        {
+            if (!atomic_get(&m_Per.m_Running) || !is_pack_dirty(0))
+                return;
+            set_pack_data(0);
+            if (!keep_dirty_on_error(0, tracked(bt_le_per_adv_set_data(m_pExtAdv, &m_Data[kSvcDataField], 1))))
+                count_sent();
+        }
 
-    template<size_t NameLen, class... T> requires (IsBTHomeDataType<T> &&...)
-    struct Advertisement
-    {
-        static constexpr size_t kMaxAdvSize = 31;
-        static constexpr size_t kAdvPacketFields = 3;
-        static constexpr size_t kAllowedSensorPayload = kMaxAdvSize - (1/*flags*/ + (NameLen - 1) + kAdvPacketFields * 2/*length byte + type byte*/);
+        struct StatsState
+        {
+            atomic_t m_Updates[AdvLayout::kObjects];
+            atomic_t m_Packs;
+            atomic_t m_Bytes;
+            atomic_t m_Errors;
+            atomic_t m_LastError;
+            atomic_t m_Cycles;
+            atomic_t m_CycleMs;
+            int64_t m_AsyncBegin = 0;
+            stats_hook_t m_pHook = nullptr;
+            void *m_pHookCtx = nullptr;
+        };
 
-        using AdvDataHolder = tools::AdvertisementsList<kAllowedSensorPayload, T...>;
-        static constexpr size_t kPacksCount =  AdvDataHolder::kSize;
+        struct AsyncState
+        {
+            k_work_delayable m_Work;
+            BasicAdvertisement *m_pSelf = nullptr;
+            bt_le_adv_param m_Param;
+            int m_DurationMs = 0;
+            int m_CleanDurationMs = -1;
+            done_callback_t m_pDone = nullptr;
+            void *m_pCtx = nullptr;
+            size_t m_NextPack = 0;
+            int m_Err = 0;
+            bool m_Started = false;
+            bool m_Running = false;
+        };
 
-        template<size_t N, class... S>
-        constexpr Advertisement(const char (&name)[N], Flags f, S... datas):
-            m_SensorData{f},
-            m_Data{
-                BT_DATA(BT_DATA_FLAGS, &g_Flags, 1),
-                BT_DATA(BT_DATA_NAME_COMPLETE, name, N - 1),
-                BT_DATA(BT_DATA_SVC_DATA16, nullptr, 0),
-            }
+        static void on_async_work(k_work *pWork)
         {
+            AsyncState *pState = CONTAINER_OF(k_work_delayable_from_work(pWork), AsyncState, m_Work);
+            pState->m_pSelf->async_step();
         }
 
-        template<class X, class Value>
-        void update(Value v)
+        void async_step()
         {
-            using FindRes = tools::FindDataTypeInAdvListT<kAllowedSensorPayload, X, T...>;
-            static_assert(FindRes::kFound, "Data type not found");
-            auto &d = m_SensorData.get(tools::index_tag_t<FindRes::kAdvertismentIndex>{});
-            d.template update<X, Value>(v);
+            if constexpr (Options::kEvents)
+            {
+                if (m_Event.m_Bursting)
+                {
+                    //the cycle was (re)started during a burst, it continues once the burst is over
+                    m_Event.m_Resume = true;
+                    return;
+                }
+            }
+
+            while (m_Async.m_NextPack < kPacksCount)
+            {
+                size_t idx = m_Async.m_NextPack++;
+                int slot = pack_slot(idx, m_Async.m_DurationMs, m_Async.m_CleanDurationMs);
+                if (!slot)
+                    continue;
+
+                const int err = push_pack(idx, m_Async.m_Started, &m_Async.m_Param);
+                if (!m_Async.m_Started && err)
+                {
+                    m_Async.m_Err = err;
+                    break;
+                }
+                m_Async.m_Started = true;
+                k_work_schedule(&m_Async.m_Work, K_MSEC(slot));
+                return;
+            }
+
+            if (m_Async.m_Started)
+                adv_stop();
+            m_Async.m_Running = false;
+            if constexpr (Options::kStats)
+                cycle_end(m_Stats.m_AsyncBegin);
+            if (m_Async.m_pDone)
+                m_Async.m_pDone(m_Async.m_pCtx);
         }
 
-        template<class X, size_t Nth, class Value>
-        void update_nth(Value v)
+        static void on_event_start(k_work *pWork)
         {
-            using FindRes = tools::FindNthDataTypeInAdvListT<kAllowedSensorPayload, Nth, X, T...>;
-            static_assert(FindRes::kFound, "Data type not found");
-            auto &d = m_SensorData.get(tools::index_tag_t<FindRes::kAdvertismentIndex>{});
-            d.template update_nth<X, Nth - FindRes::kAdvertismentDataOffset, Value>(v);
+            CONTAINER_OF(pWork, EventState, m_Start)->m_pSelf->event_start();
         }
 
-        void advertise()
+        static void on_event_end(k_work *pWork)
         {
-            const struct bt_le_adv_param adv_param[] = {
-                BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_USE_IDENTITY, BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, nullptr) 
-            };
-            advertise_with(adv_param, 1500);
+            CONTAINER_OF(k_work_delayable_from_work(pWork), EventState, m_End)->m_pSelf->event_end();
         }
 
-        void advertise_with(const bt_le_adv_param *adv_param, int adv_duration_ms)
+        void event_start()
         {
-            auto &beg = m_SensorData.get(tools::index_tag_t<0>{});
-            m_Data[kAdvPacketFields - 1].data = beg.m_SVCData;
-            m_Data[kAdvPacketFields - 1].data_len = beg.kSVCDataSize;
-            bt_le_adv_start(adv_param, m_Data, kAdvPacketFields, nullptr, 0);
-            k_sleep(K_MSEC(adv_duration_ms));
+            k_spinlock_key_t key = k_spin_lock(&m_Event.m_Lock);
+            const size_t size = m_Event.m_PendingSize;
+            for(size_t i = 0; i < size; ++i)
+                m_Event.m_Plain[i] = m_Event.m_Pending[i];
+            const int duration = m_Event.m_DurationMs;
+            k_spin_unlock(&m_Event.m_Lock, key);
 
-            if constexpr (kPacksCount > 1)
+            bind_name();
+            if constexpr (Options::kEncrypted)
+            {
+                m_Enc.m_Cipher.encrypt(m_Event.m_Plain, size, m_Enc.m_Counter++, m_Event.m_Encrypted);
+                m_Data[kSvcDataField].data = m_Event.m_Encrypted;
+                m_Data[kSvcDataField].data_len = size + kEncryptionOverhead;
+            }
+            else
             {
-                auto update_adv = [&](auto index_tag)
+                m_Data[kSvcDataField].data = m_Event.m_Plain;
+                m_Data[kSvcDataField].data_len = size;
+            }
+
+            if (m_Event.m_Bursting)
+                adv_update();
+            else
+            {
+                if constexpr (Options::kAsync)
                 {
-                    auto &d = m_SensorData.get(index_tag);
-                    m_Data[kAdvPacketFields - 1].data = d.m_SVCData;
-                    m_Data[kAdvPacketFields - 1].data_len = d.kSVCDataSize;
-                    bt_le_adv_update_data(m_Data, kAdvPacketFields, nullptr, 0);
-                    k_sleep(K_MSEC(adv_duration_ms));
-                };
+                    if (m_Async.m_Running)
+                    {
+                        //the interrupted pack is sent again once the burst is over
+                        k_work_cancel_delayable(&m_Async.m_Work);
+                        if (m_Async.m_Started)
+                        {
+                            adv_stop();
+                            m_Async.m_Started = false;
+                            if (m_Async.m_NextPack)
+                                --m_Async.m_NextPack;
+                        }
+                        m_Event.m_Resume = true;
+                    }
+                }
 
-                [&]<size_t... Idx>(std::index_sequence<Idx...>)
+                const struct bt_le_adv_param adv_param[] = {
+                    BT_LE_ADV_PARAM_INIT(Options::kDefaultAdvOpt, Options::kEventIntMin, Options::kEventIntMax, nullptr)
+                };
+                if (adv_start(adv_param))
                 {
-                    (update_adv(tools::index_tag_t<Idx + 1>{}),...);
-                }(std::make_index_sequence<kPacksCount - 1>{});//<-- immediately invoke
+                    //the event is dropped, the interrupted cycle goes on
+                    resume_async();
+                    return;
+                }
+                m_Event.m_Bursting = true;
             }
+            k_work_reschedule(&m_Event.m_End, K_MSEC(duration));
+        }
 
-            bt_le_adv_stop();
+        void event_end()
+        {
+            adv_stop();
+            m_Event.m_Bursting = false;
+            resume_async();
         }
 
+        void resume_async()
+        {
+            if constexpr (Options::kAsync)
+            {
+                if (m_Event.m_Resume)
+                {
+                    m_Event.m_Resume = false;
+                    if (m_Async.m_Running)
+                        k_work_schedule(&m_Async.m_Work, K_NO_WAIT);
+                }
+            }
+        }
+
+        [[no_unique_address]] std::conditional_t<Options::kAsync, AsyncState, tools::Empty> m_Async{};
+        [[no_unique_address]] std::conditional_t<Options::kEvents, EventState, tools::Empty> m_Event{};
+
+    public:
         AdvDataHolder m_SensorData;
 
-        bt_data m_Data[kAdvPacketFields];
-        inline static uint8_t g_Flags = BT_LE_AD_NO_BREDR | BT_LE_AD_GENERAL;
+        bt_data m_Data[3];
+        const char *m_pName;
+        bt_le_ext_adv *m_pExtAdv = nullptr;//only used with Options::kExtended
+        bt_le_ext_adv *m_pSets[kSetsAvailable ? kPacksCount : 1] = {};//advertise_sets
+        bool m_SetsRunning = false;
+        atomic_t m_DirtyPacks = ATOMIC_INIT(atomic_val_t(kAllPacksMask));
+        [[no_unique_address]] std::conditional_t<Options::kEncrypted, EncryptionState, tools::Empty> m_Enc{};
+        [[no_unique_address]] std::conditional_t<Options::kDoubleBuffered, BufferState, tools::Empty> m_Buf{};
+        [[no_unique_address]] std::conditional_t<Options::kStats, StatsState, tools::Empty> m_Stats{};
+        [[no_unique_address]] std::conditional_t<Options::kPeriodic, PeriodicState, tools::Empty> m_Per{};
+        static constexpr uint8_t g_Flags = BT_LE_AD_NO_BREDR | BT_LE_AD_GENERAL;
+    };
+
+    template<size_t NameLen, class... T> requires (IsBTHomeDataType<T> &&...)
+    struct Advertisement: BasicAdvertisement<AdvOptions, NameLen, T...>
+    {
+        using BasicAdvertisement<AdvOptions, NameLen, T...>::BasicAdvertisement;
     };
 
     template<size_t N, class... T>
     Advertisement(const char (&name)[N], Flags f, T... Data) -> Advertisement<N, T...>;
+
+    //requires CONFIG_BT_EXT_ADV and a controller supporting extended advertising
+    template<size_t NameLen, class... T> requires (IsBTHomeDataType<T> &&...)
+    struct ExtAdvertisement: BasicAdvertisement<ExtAdvOptions, NameLen, T...>
+    {
+        using BasicAdvertisement<ExtAdvOptions, NameLen, T...>::BasicAdvertisement;
+    };
+
+    template<size_t N, class... T>
+    ExtAdvertisement(const char (&name)[N], Flags f, T... Data) -> ExtAdvertisement<N, T...>;
+
+    //set_encryption_key and set_encryption_mac must be called before advertising
+    template<size_t NameLen, class... T> requires (IsBTHomeDataType<T> &&...)
+    struct EncryptedAdvertisement: BasicAdvertisement<Encrypted<AdvOptions>, NameLen, T...>
+    {
+        using BasicAdvertisement<Encrypted<AdvOptions>, NameLen, T...>::BasicAdvertisement;
+    };
+
+    template<size_t N, class... T>
+    EncryptedAdvertisement(const char (&name)[N], Flags f, T... Data) -> EncryptedAdvertisement<N, T...>;
+
+    //update/update_nth/batch may be called from any thread while advertising
+    template<size_t NameLen, class... T> requires (IsBTHomeDataType<T> &&...)
+    struct DoubleBufferedAdvertisement: BasicAdvertisement<DoubleBuffered<AdvOptions>, NameLen, T...>
+    {
+        using BasicAdvertisement<DoubleBuffered<AdvOptions>, NameLen, T...>::BasicAdvertisement;
+    };
+
+    template<size_t N, class... T>
+    DoubleBufferedAdvertisement(const char (&name)[N], Flags f, T... Data) -> DoubleBufferedAdvertisement<N, T...>;
+
+    //compare kPacksCount with Advertisement's to see what moving the name saves
+    template<size_t NameLen, class... T> requires (IsBTHomeDataType<T> &&...)
+    struct ScanNameAdvertisement: BasicAdvertisement<NameInScanResponse<AdvOptions>, NameLen, T...>
+    {
+        using BasicAdvertisement<NameInScanResponse<AdvOptions>, NameLen, T...>::BasicAdvertisement;
+    };
+
+    template<size_t N, class... T>
+    ScanNameAdvertisement(const char (&name)[N], Flags f, T... Data) -> ScanNameAdvertisement<N, T...>;
 }
 
 #endif
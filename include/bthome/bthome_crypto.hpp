@@ -0,0 +1,212 @@
+#ifndef BTHHOME_CRYPTO_HPP_
+#define BTHHOME_CRYPTO_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace BTHome
+{
+    namespace tools
+    {
+        //AES-128, encryption direction only (that's all CCM needs)
+        //round keys are expanded once in the constructor
+        struct Aes128
+        {
+            static constexpr size_t kBlockSize = 16;
+            static constexpr size_t kRounds = 10;
+
+            static constexpr uint8_t kSBox[256] = {
+                0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+                0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+                0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+                0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+                0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+                0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+                0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+                0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+                0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+                0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+                0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+                0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+                0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+                0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+                0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+                0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+            };
+
+            constexpr Aes128() = default;
+
+            constexpr Aes128(const uint8_t (&key)[16])
+            {
+                for(size_t i = 0; i < 16; ++i)
+                    m_RoundKeys[i] = key[i];
+
+                uint8_t rcon = 1;
+                for(size_t i = 16; i < sizeof(m_RoundKeys); i += 4)
+                {
+                    uint8_t t[4] = {m_RoundKeys[i - 4], m_RoundKeys[i - 3], m_RoundKeys[i - 2], m_RoundKeys[i - 1]};
+                    if (i % 16 == 0)
+                    {
+                        uint8_t t0 = t[0];
+                        t[0] = kSBox[t[1]] ^ rcon;
+                        t[1] = kSBox[t[2]];
+                        t[2] = kSBox[t[3]];
+                        t[3] = kSBox[t0];
+                        rcon = xtime(rcon);
+                    }
+                    for(size_t j = 0; j < 4; ++j)
+                        m_RoundKeys[i + j] = m_RoundKeys[i + j - 16] ^ t[j];
+                }
+            }
+
+            static constexpr uint8_t xtime(uint8_t x) { return uint8_t((x << 1) ^ ((x & 0x80) ? 0x1b : 0)); }
+
+            constexpr void encrypt_block(const uint8_t *pIn, uint8_t *pOut) const
+            {
+                uint8_t s[16] = {};
+                for(size_t i = 0; i < 16; ++i)
+                    s[i] = pIn[i] ^ m_RoundKeys[i];
+
+                for(size_t r = 1; r <= kRounds; ++r)
+                {
+                    //SubBytes + ShiftRows (state is column-major)
+                    uint8_t t[16] = {};
+                    for(size_t c = 0; c < 4; ++c)
+                        for(size_t row = 0; row < 4; ++row)
+                            t[c * 4 + row] = kSBox[s[((c + row) % 4) * 4 + row]];
+
+                    //MixColumns, skipped in the last round
+                    if (r != kRounds)
+                    {
+                        for(size_t c = 0; c < 4; ++c)
+                        {
+                            uint8_t *col = t + c * 4;
+                            uint8_t a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+                            uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+                            col[0] ^= all ^ xtime(a0 ^ a1);
+                            col[1] ^= all ^ xtime(a1 ^ a2);
+                            col[2] ^= all ^ xtime(a2 ^ a3);
+                            col[3] ^= all ^ xtime(a3 ^ a0);
+                        }
+                    }
+
+                    for(size_t i = 0; i < 16; ++i)
+                        s[i] = t[i] ^ m_RoundKeys[r * 16 + i];
+                }
+
+                for(size_t i = 0; i < 16; ++i)
+                    pOut[i] = s[i];
+            }
+
+            uint8_t m_RoundKeys[16 * (kRounds + 1)] = {};
+        };
+
+        //BTHome v2 encryption: AES-CCM, 13 bytes nonce, 4 bytes MIC, no additional data
+        //nonce = MAC + UUID16 (0xd2 0xfc) + device info byte + counter
+        struct Cipher
+        {
+            static constexpr size_t kMicSize = 4;
+            static constexpr size_t kCounterSize = 4;
+            static constexpr size_t kOverhead = kCounterSize + kMicSize;//bytes added to the service data
+            static constexpr size_t kHeaderSize = 3;//UUID16 + device info, sent in the clear
+            static constexpr size_t kNonceSize = 13;
+
+            constexpr Cipher() = default;
+            constexpr Cipher(const uint8_t (&key)[16]): m_Aes(key) {}
+
+            //mac is in the printed order (most significant byte first)
+            constexpr void set_mac(const uint8_t (&mac)[6])
+            {
+                for(size_t i = 0; i < 6; ++i)
+                    m_Mac[i] = mac[i];
+            }
+
+            //pHeader: the kHeaderSize clear bytes of the service data
+            constexpr void make_nonce(const uint8_t *pHeader, uint32_t counter, uint8_t (&nonce)[kNonceSize]) const
+            {
+                for(size_t i = 0; i < 6; ++i)
+                    nonce[i] = m_Mac[i];
+                for(size_t i = 0; i < kHeaderSize; ++i)
+                    nonce[6 + i] = pHeader[i];
+                for(size_t i = 0; i < kCounterSize; ++i)
+                    nonce[9 + i] = uint8_t(counter >> (i * 8));
+            }
+
+            //pSrc: plain service data (UUID16 + device info + objects) of len bytes
+            //pDst: receives len + kOverhead bytes: header, encrypted objects, counter, MIC
+            //pSrc and pDst must not overlap
+            constexpr void encrypt(const uint8_t *pSrc, size_t len, uint32_t counter, uint8_t *pDst) const
+            {
+                const size_t payloadLen = len - kHeaderSize;
+                const uint8_t *pPlain = pSrc + kHeaderSize;
+                uint8_t *pOut = pDst + kHeaderSize;
+
+                uint8_t nonce[kNonceSize] = {};
+                make_nonce(pSrc, counter, nonce);
+
+                //CBC-MAC over B0 and the zero padded plain text
+                uint8_t x[16] = {};
+                x[0] = ((kMicSize - 2) / 2) << 3 | (2 - 1)/*L = 2*/;
+                for(size_t i = 0; i < kNonceSize; ++i)
+                    x[1 + i] = nonce[i];
+                x[14] = uint8_t(payloadLen >> 8);
+                x[15] = uint8_t(payloadLen);
+                m_Aes.encrypt_block(x, x);
+                for(size_t off = 0; off < payloadLen; off += 16)
+                {
+                    for(size_t i = 0; i < 16 && (off + i) < payloadLen; ++i)
+                        x[i] ^= pPlain[off + i];
+                    m_Aes.encrypt_block(x, x);
+                }
+
+                //CTR: A0 encrypts the tag, A1.. the payload
+                uint8_t a[16] = {};
+                uint8_t s[16] = {};
+                a[0] = 2 - 1/*L = 2*/;
+                for(size_t i = 0; i < kNonceSize; ++i)
+                    a[1 + i] = nonce[i];
+                for(size_t off = 0, ctr = 1; off < payloadLen; off += 16, ++ctr)
+                {
+                    a[14] = uint8_t(ctr >> 8);
+                    a[15] = uint8_t(ctr);
+                    m_Aes.encrypt_block(a, s);
+                    for(size_t i = 0; i < 16 && (off + i) < payloadLen; ++i)
+                        pOut[off + i] = pPlain[off + i] ^ s[i];
+                }
+
+                for(size_t i = 0; i < kHeaderSize; ++i)
+                    pDst[i] = pSrc[i];
+                for(size_t i = 0; i < kCounterSize; ++i)
+                    pOut[payloadLen + i] = nonce[9 + i];
+
+                a[14] = a[15] = 0;
+                m_Aes.encrypt_block(a, s);
+                for(size_t i = 0; i < kMicSize; ++i)
+                    pOut[payloadLen + kCounterSize + i] = x[i] ^ s[i];
+            }
+
+            Aes128 m_Aes;
+            uint8_t m_Mac[6] = {};
+        };
+
+        //test vector from the BTHome v2 specification (encryption section)
+        constexpr bool CipherSelfTest()
+        {
+            constexpr uint8_t key[16] = {0x23, 0x1d, 0x39, 0xc1, 0xd7, 0xcc, 0x1a, 0xb1, 0xae, 0xe2, 0x24, 0xcd, 0x09, 0x6d, 0xb9, 0x32};
+            constexpr uint8_t mac[6] = {0x54, 0x48, 0xe6, 0x8f, 0x80, 0xa5};
+            constexpr uint8_t plain[] = {0xd2, 0xfc, 0x41, 0x02, 0xca, 0x09, 0x03, 0xbf, 0x13};
+            constexpr uint8_t expected[] = {0xd2, 0xfc, 0x41, 0xa4, 0x72, 0x66, 0xc9, 0x5f, 0x73, 0x00, 0x11, 0x22, 0x33, 0x78, 0x23, 0x72, 0x14};
+
+            Cipher c(key);
+            c.set_mac(mac);
+            uint8_t res[sizeof(expected)] = {};
+            c.encrypt(plain, sizeof(plain), 0x33221100, res);
+            for(size_t i = 0; i < sizeof(expected); ++i)
+                if (res[i] != expected[i])
+                    return false;
+            return true;
+        }
+        static_assert(CipherSelfTest(), "BTHome AES-CCM implementation is broken");
+    }
+}
+#endif
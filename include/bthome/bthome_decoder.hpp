@@ -0,0 +1,171 @@
+#ifndef BTHHOME_DECODER_HPP_
+#define BTHHOME_DECODER_HPP_
+
+#include "bthome_tools.hpp"
+#include "bthome_types.hpp"
+
+namespace BTHome
+{
+    //Host side (gateway) decoder. Doesn't depend on zephyr, doesn't allocate.
+    //The dispatch table is generated from KnownTypes, the same definitions the encoder uses.
+    namespace decoder
+    {
+        enum class Kind: uint8_t
+        {
+            Unknown,
+            Number,//little-endian integer, value = raw / factor
+            Bytes,//fixed size, interpretation is up to the caller (firmware versions)
+            Variable,//length byte followed by that many bytes (text, raw)
+        };
+
+        struct ObjectInfo
+        {
+            Kind m_Kind = Kind::Unknown;
+            uint8_t m_Size = 0;
+            bool m_Signed = false;
+            float m_Factor = 1.f;
+        };
+
+        template<class X>
+        constexpr ObjectInfo InfoOf()
+        {
+            if constexpr (kIsVariable<X>)
+                return {Kind::Variable, 1/*length byte*/, false, 1.f};
+            else if constexpr (requires { X::kFactor; X::kSigned; })
+                return {Kind::Number, X::kDataSize, X::kSigned, X::kFactor};
+            else
+                return {Kind::Bytes, X::kDataSize, false, 1.f};
+        }
+
+        struct ObjectTable
+        {
+            ObjectInfo m_Entries[256];
+            bool m_Unique = true;//no two types claim the same object id
+
+            constexpr const ObjectInfo& operator[](uint8_t id) const { return m_Entries[id]; }
+        };
+
+        template<class... X>
+        constexpr ObjectTable MakeTable(tools::TypeList<X...>)
+        {
+            ObjectTable t{};
+            auto add = [&](uint8_t id, ObjectInfo info)
+            {
+                if (t.m_Entries[id].m_Kind != Kind::Unknown)
+                    t.m_Unique = false;
+                t.m_Entries[id] = info;
+            };
+            (add(X::kDataId, InfoOf<X>()), ...);
+            return t;
+        }
+
+        inline constexpr ObjectTable kObjects = MakeTable(KnownTypes{});
+        static_assert(kObjects.m_Unique, "Object id is used by more than one type");
+
+        struct Object
+        {
+            uint8_t m_Id;
+            const ObjectInfo *m_pInfo;
+            const uint8_t *m_pData;//points into the decoded buffer
+            int64_t m_Raw;//sign extended for signed types, 0 for Kind::Bytes and Kind::Variable
+            size_t m_Len = 0;//bytes at m_pData
+
+            template<class X>
+            constexpr bool is() const { return m_Id == X::kDataId; }
+
+            constexpr double value() const { return double(m_Raw) / double(m_pInfo->m_Factor); }
+        };
+
+        enum class Error: uint8_t
+        {
+            Ok,
+            NotBTHome,//too short or the UUID is not 0xfcd2
+            UnsupportedVersion,
+            Encrypted,
+            UnknownObject,//decoding stops: the size of an unknown object can't be known
+            Truncated,
+            TooManyObjects,
+        };
+
+        struct Header
+        {
+            uint8_t m_DeviceInfo = 0;
+
+            constexpr bool encrypted() const { return m_DeviceInfo & uint8_t(Flags::Encryption); }
+            constexpr bool trigger() const { return m_DeviceInfo & uint8_t(Flags::Trigger); }
+            constexpr uint8_t version() const { return m_DeviceInfo >> 5; }
+        };
+
+        constexpr int64_t ReadRaw(const uint8_t *p, const ObjectInfo &info)
+        {
+            int64_t raw = 0;
+            for(uint8_t i = 0; i < info.m_Size; ++i)
+                raw |= int64_t(p[i]) << (i * 8);
+            if (info.m_Signed && (p[info.m_Size - 1] & 0x80))
+                raw -= int64_t(1) << (info.m_Size * 8);
+            return raw;
+        }
+
+        //pData: service data starting with the UUID16 (0xd2 0xfc), exactly what AdvertismentSVC::m_SVCData holds
+        //visitor is called with const Object& for every object in order
+        template<class Visitor>
+        constexpr Error decode(const uint8_t *pData, size_t len, Visitor &&visitor, Header *pHeader = nullptr)
+        {
+            if (len < 3 || pData[0] != 0xd2 || pData[1] != 0xfc)
+                return Error::NotBTHome;
+
+            Header h{pData[2]};
+            if (pHeader)
+                *pHeader = h;
+            if (h.version() != (kBTHomeVer >> 5))
+                return Error::UnsupportedVersion;
+            if (h.encrypted())
+                return Error::Encrypted;
+
+            for(size_t off = 3; off < len;)
+            {
+                const uint8_t id = pData[off++];
+                const ObjectInfo &info = kObjects[id];
+                if (info.m_Kind == Kind::Unknown)
+                    return Error::UnknownObject;
+                if (off + info.m_Size > len)
+                    return Error::Truncated;
+
+                if (info.m_Kind == Kind::Variable)
+                {
+                    const size_t n = pData[off++];
+                    if (off + n > len)
+                        return Error::Truncated;
+                    const Object o{id, &info, pData + off, 0, n};
+                    visitor(o);
+                    off += n;
+                    continue;
+                }
+
+                const uint8_t *p = pData + off;
+                const Object o{id, &info, p, info.m_Kind == Kind::Number ? ReadRaw(p, info) : 0, info.m_Size};
+                visitor(o);
+                off += info.m_Size;
+            }
+            return Error::Ok;
+        }
+
+        //fixed-size result variant; count receives the number of decoded objects
+        template<size_t N>
+        constexpr Error decode(const uint8_t *pData, size_t len, Object (&res)[N], size_t &count, Header *pHeader = nullptr)
+        {
+            count = 0;
+            bool overflow = false;
+            Error e = decode(pData, len, [&](const Object &o){
+                if (count < N)
+                    res[count++] = o;
+                else
+                    overflow = true;
+            }, pHeader);
+            if (e == Error::Ok && overflow)
+                return Error::TooManyObjects;
+            return e;
+        }
+    }
+}
+#endif
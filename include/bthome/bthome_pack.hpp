@@ -0,0 +1,377 @@
+#ifndef BTHHOME_PACK_HPP_
+#define BTHHOME_PACK_HPP_
+
+#include <type_traits>
+#include <utility>
+#include "bthome_svc.hpp"
+
+//Splitting of the data types into advertisement packs.
+//Doesn't depend on zephyr so the layouts can be built and inspected on a host.
+namespace BTHome
+{
+    namespace tools
+    {
+        //location of an object inside the packs
+        struct ObjectLocation
+        {
+            uint8_t m_Pack;
+            uint8_t m_Offset;//offset of the object id byte inside the pack's m_SVCData
+        };
+
+        template<size_t MaxObjects>
+        struct LayoutResult
+        {
+            ObjectLocation m_Locations[MaxObjects]{};
+            uint8_t m_Order[MaxObjects]{};
+            uint8_t m_PackBegin[MaxObjects + 1]{};
+            size_t m_Packs = 0;
+            bool m_Fits = true;
+        };
+
+        //How objects are split into packs.
+        //The pack count is minimized: exact search for up to kExactSearchLimit objects, first-fit-decreasing beyond that.
+        //If that doesn't save a pack the objects are placed in declaration order, as they always were.
+        //Inside a pack objects are sorted by object id as BTHome v2 requires, equal ids keep declaration order.
+        //A variable length object (text, raw) must be the last one of its pack, so only the used part of it
+        //needs to be advertised: a pack holds at most one of them, and only objects with lower ids next to it.
+        //Pack p holds objects m_Order[m_PackBegin[p]...m_PackBegin[p + 1]) in that order.
+        //constexpr so the compile time Layout and the runtime schema share the very same placement.
+        template<size_t MaxObjects>
+        struct LayoutEngine
+        {
+            static constexpr size_t kHeaderSize = 2/*ID 0xd2fc*/ + 1/*flags*/;
+            static constexpr size_t kExactSearchLimit = 10;
+
+            using Bins = uint8_t[MaxObjects];
+            using Result = LayoutResult<MaxObjects>;
+
+            const uint8_t *m_pIds;
+            const uint8_t *m_pCosts;//1 (id) + data size
+            size_t m_Objects;
+            size_t m_Capacity;//bytes per pack after the header
+            const bool *m_pVariable;//optional
+
+            constexpr LayoutEngine(const uint8_t *pIds, const uint8_t *pCosts, size_t objects, size_t sizeLimit, const bool *pVariable = nullptr):
+                m_pIds(pIds),
+                m_pCosts(pCosts),
+                m_Objects(objects),
+                m_Capacity(sizeLimit > kHeaderSize ? sizeLimit - kHeaderSize : 0),
+                m_pVariable(pVariable)
+            {}
+
+            constexpr bool variable(size_t i) const { return m_pVariable && m_pVariable[i]; }
+
+            //what a pack holds so far
+            struct Fill
+            {
+                size_t m_Bytes = 0;
+                int m_VariableId = -1;//none
+                int m_MaxFixedId = -1;//none
+            };
+
+            //the variable length object of a pack keeps the highest id, so sorting by id puts it last
+            constexpr bool can_take(const Fill &f, size_t i) const
+            {
+                if (f.m_Bytes + m_pCosts[i] > m_Capacity)
+                    return false;
+                if (variable(i))
+                    return f.m_VariableId < 0 && f.m_MaxFixedId < m_pIds[i];
+                return f.m_VariableId < 0 || m_pIds[i] < f.m_VariableId;
+            }
+
+            constexpr void take(Fill &f, size_t i) const
+            {
+                f.m_Bytes += m_pCosts[i];
+                if (variable(i))
+                    f.m_VariableId = m_pIds[i];
+                else if (m_pIds[i] > f.m_MaxFixedId)
+                    f.m_MaxFixedId = m_pIds[i];
+            }
+
+            //declaration order, a new pack starts when the current one can't take the object
+            constexpr size_t next_fit(Bins &bin) const
+            {
+                size_t packs = 0;
+                Fill fill;
+                for(size_t i = 0; i < m_Objects; ++i)
+                {
+                    if (!packs || !can_take(fill, i))
+                    {
+                        ++packs;
+                        fill = {};
+                    }
+                    bin[i] = uint8_t(packs - 1);
+                    take(fill, i);
+                }
+                return packs;
+            }
+
+            //object indices, biggest first
+            constexpr void by_size(Bins &items) const
+            {
+                for(size_t i = 0; i < m_Objects; ++i)
+                {
+                    size_t j = i;
+                    for(; j > 0 && m_pCosts[items[j - 1]] < m_pCosts[i]; --j)
+                        items[j] = items[j - 1];
+                    items[j] = uint8_t(i);
+                }
+            }
+
+            constexpr size_t first_fit_decreasing(Bins &bin) const
+            {
+                Bins items{};
+                by_size(items);
+                Fill fill[MaxObjects]{};
+                size_t packs = 0;
+                for(size_t i = 0; i < m_Objects; ++i)
+                {
+                    size_t b = 0;
+                    while(b < packs && !can_take(fill[b], items[i]))
+                        ++b;
+                    if (b == packs)
+                        ++packs;
+                    take(fill[b], items[i]);
+                    bin[items[i]] = uint8_t(b);
+                }
+                return packs;
+            }
+
+            constexpr bool fits_into(const Bins &items, size_t i, size_t packs, Fill (&fill)[MaxObjects], Bins &bin) const
+            {
+                if (i == m_Objects)
+                    return true;
+                for(size_t b = 0; b < packs; ++b)
+                {
+                    const bool empty = !fill[b].m_Bytes;
+                    if (can_take(fill[b], items[i]))
+                    {
+                        const Fill before = fill[b];
+                        take(fill[b], items[i]);
+                        bin[items[i]] = uint8_t(b);
+                        if (fits_into(items, i + 1, packs, fill, bin))
+                            return true;
+                        fill[b] = before;
+                    }
+                    if (empty)
+                        break;//the remaining packs are empty as well, no point trying them
+                }
+                return false;
+            }
+
+            //returns upper if no arrangement with fewer packs exists
+            constexpr size_t exact(Bins &bin, size_t upper) const
+            {
+                Bins items{};
+                by_size(items);
+                size_t total = 0;
+                for(size_t i = 0; i < m_Objects; ++i)
+                    total += m_pCosts[i];
+                for(size_t packs = (total + m_Capacity - 1) / m_Capacity; packs < upper; ++packs)
+                {
+                    Fill fill[MaxObjects]{};
+                    if (fits_into(items, 0, packs, fill, bin))
+                        return packs;
+                }
+                return upper;
+            }
+
+            constexpr Result compute() const
+            {
+                Result r;
+                for(size_t i = 0; i < m_Objects; ++i)
+                    if (m_pCosts[i] > m_Capacity)
+                        r.m_Fits = false;
+                if (!r.m_Fits)
+                    return r;
+
+                Bins bin{};
+                size_t packs = next_fit(bin);
+
+                Bins better{};
+                size_t betterPacks = first_fit_decreasing(better);
+                if (m_Objects <= kExactSearchLimit)
+                {
+                    Bins best{};
+                    if (size_t bestPacks = exact(best, betterPacks); bestPacks < betterPacks)
+                    {
+                        betterPacks = bestPacks;
+                        for(size_t i = 0; i < m_Objects; ++i)
+                            better[i] = best[i];
+                    }
+                }
+
+                if (betterPacks < packs)
+                {
+                    packs = betterPacks;
+                    for(size_t i = 0; i < m_Objects; ++i)
+                        bin[i] = better[i];
+                }
+
+                //packs are numbered by their first object in declaration order
+                uint8_t number[MaxObjects];
+                for(size_t p = 0; p < MaxObjects; ++p)
+                    number[p] = 0xff;
+                size_t next = 0;
+                for(size_t i = 0; i < m_Objects; ++i)
+                    if (number[bin[i]] == 0xff)
+                        number[bin[i]] = uint8_t(next++);
+
+                size_t pos = 0;
+                for(size_t p = 0; p < packs; ++p)
+                {
+                    const size_t begin = pos;
+                    r.m_PackBegin[p] = uint8_t(begin);
+                    for(size_t i = 0; i < m_Objects; ++i)
+                    {
+                        if (number[bin[i]] != p)
+                            continue;
+                        //stable insertion by object id
+                        size_t j = pos++;
+                        for(; j > begin && m_pIds[r.m_Order[j - 1]] > m_pIds[i]; --j)
+                            r.m_Order[j] = r.m_Order[j - 1];
+                        r.m_Order[j] = uint8_t(i);
+                    }
+
+                    size_t off = kHeaderSize;
+                    for(size_t j = begin; j < pos; ++j)
+                    {
+                        r.m_Locations[r.m_Order[j]] = {uint8_t(p), uint8_t(off)};
+                        off += m_pCosts[r.m_Order[j]];
+                    }
+                }
+                r.m_PackBegin[packs] = uint8_t(m_Objects);
+                r.m_Packs = packs;
+                return r;
+            }
+        };
+
+        //compile time layout of T... into packs of at most SizeLimit bytes
+        template<size_t SizeLimit, class... T>
+        struct Layout
+        {
+            static constexpr size_t kObjects = sizeof...(T);
+            static constexpr uint8_t kIds[] = {T::kDataId...};
+            static constexpr uint8_t kCosts[] = {uint8_t(1/*id*/ + T::kDataSize)...};
+            static constexpr bool kVariable[] = {kIsVariable<T>...};
+
+            using Result = LayoutResult<kObjects>;
+
+            static consteval Result compute()
+            {
+                return LayoutEngine<kObjects>(kIds, kCosts, kObjects, SizeLimit, kVariable).compute();
+            }
+
+            static constexpr Result kResult = compute();
+            static_assert(kResult.m_Fits, "Data type is too big");
+            static_assert(kObjects < 256, "Too many objects");
+
+            static constexpr size_t kPacksCount = kResult.m_Packs;
+            static constexpr const ObjectLocation (&kLocations)[kObjects] = kResult.m_Locations;
+
+            //kSVCDataSize of pack p
+            static constexpr size_t pack_size(size_t p)
+            {
+                size_t size = LayoutEngine<kObjects>::kHeaderSize;
+                for(size_t j = kResult.m_PackBegin[p]; j < kResult.m_PackBegin[p + 1]; ++j)
+                    size += kCosts[kResult.m_Order[j]];
+                return size;
+            }
+
+            template<size_t P, class Seq = std::make_index_sequence<kResult.m_PackBegin[P + 1] - kResult.m_PackBegin[P]>>
+            struct PackT;
+
+            template<size_t P, size_t... J>
+            struct PackT<P, std::index_sequence<J...>>
+            {
+                static constexpr size_t kFirst = kResult.m_PackBegin[P];
+                using type = AdvertismentSVC<NthType<kResult.m_Order[kFirst + J], T...>...>;
+                static_assert(((type::offset_of(J) == kResult.m_Locations[kResult.m_Order[kFirst + J]].m_Offset) && ...), "Pack layout doesn't match the computed locations");
+                static_assert(((J == 0 || kIds[kResult.m_Order[kFirst + J - 1]] <= kIds[kResult.m_Order[kFirst + J]]) && ...), "Pack objects must be in ascending id order");
+            };
+
+            template<size_t P>
+            using Pack = typename PackT<P>::type;
+
+            template<class Seq = std::make_index_sequence<kPacksCount>>
+            struct PacksT;
+
+            template<size_t... P>
+            struct PacksT<std::index_sequence<P...>>
+            {
+                using type = TypeList<Pack<P>...>;
+            };
+
+            using Packs = typename PacksT<>::type;
+        };
+
+        //all three would fit one pack, but Channel (0x60) can't go before Text (0x53) and Text has to be last
+        static_assert([]{
+            using L = Layout<31, Temperature, Text<8>, Channel>;
+            return L::Packs::kSize == 2 && L::kLocations[1].m_Pack != L::kLocations[2].m_Pack;
+        }(), "A variable length object shares its pack with a higher id");
+
+        struct Empty{};
+
+        template<size_t Idx>
+        struct index_tag_t{
+            static constexpr size_t kIdx = Idx;
+        };
+
+        template<size_t Idx, class T>
+        struct IndexedBase: T
+        {
+            using T::T;
+            constexpr T& get(index_tag_t<Idx>) { return *this; }
+        };
+
+        template<class Indexes, class Types>
+        struct MakeIndexedTypes;
+
+        template<size_t... Idx, class... Types>
+        struct MakeIndexedTypes<std::index_sequence<Idx...>, TypeList<Types...>>
+        {
+            using type = TypeList<IndexedBase<Idx, Types>...>;
+        };
+
+        template<class... AdvTypes>
+        struct AdvertisementsListT: AdvTypes...
+        {
+            static constexpr size_t kSize = sizeof...(AdvTypes);
+            using AdvTypes::get...;
+
+            constexpr AdvertisementsListT(Flags f):AdvTypes{f}...
+            {}
+
+            //calls f with the advertisement at runtime index idx
+            template<class F>
+            constexpr void visit(size_t idx, F &&f)
+            {
+                [&]<size_t... Idx>(std::index_sequence<Idx...>)
+                {
+                    ((Idx == idx ? (f(this->get(index_tag_t<Idx>{})), true) : false) || ...);
+                }(std::make_index_sequence<kSize>{});
+            }
+        };
+
+        template<class AdvList>
+        struct MakeAdvertisementList;
+
+        template<class... AdvTypes>
+        struct MakeAdvertisementList<TypeList<AdvTypes...>>
+        {
+            using type = AdvertisementsListT<AdvTypes...>;
+        };
+
+        template<size_t SizeLimit, class... DataTypes>
+        using PackedAdvertisementsList = typename Layout<SizeLimit, DataTypes...>::Packs;
+
+        template<class Packed>
+        using AdvertisementsListFromPacked = MakeAdvertisementList<typename MakeIndexedTypes<decltype(std::make_index_sequence<Packed::kSize>()), Packed>::type>::type;
+
+        template<size_t SizeLimit, class... DataTypes>
+        using AdvertisementsList = AdvertisementsListFromPacked<PackedAdvertisementsList<SizeLimit, DataTypes...>>;
+    }
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef BTHHOME_RUNTIME_HPP_
+#define BTHHOME_RUNTIME_HPP_
+
+#include "bthome_pack.hpp"
+#include "bthome_decoder.hpp"
+
+//Runtime counterpart of AdvertisementsList for object sets only known at boot (e.g. detected daughterboards).
+//Packs are laid out by the same LayoutEngine as the compile time lists, so the bytes are identical.
+//Doesn't depend on zephyr and doesn't allocate.
+namespace BTHome
+{
+    //sensor payload of a legacy Advertisement<NameLen, ...>, NameLen counts the terminating 0 like the template does
+    constexpr size_t LegacySensorPayload(size_t NameLen)
+    {
+        return 31 - (1/*flags*/ + (NameLen - 1) + 3 * 2/*length byte + type byte*/);
+    }
+
+    enum class SchemaError: uint8_t
+    {
+        Ok,
+        TooManyObjects,
+        UnknownObject,//not in KnownTypes
+        TooBig,//an object doesn't fit into a pack
+        ArenaTooSmall,
+        VariableObject,//text and raw need their maximum length, only the compile time lists support them
+    };
+
+    //MaxObjects bounds the lookup tables; the pack bytes live in a caller provided arena
+    template<size_t MaxObjects>
+    struct RuntimeAdvertisementsList
+    {
+        static_assert(MaxObjects <= 32, "Too many objects for the dirty mask");
+        static constexpr uint8_t kNone = 0xff;
+
+        static constexpr size_t kMaxObjectSize = []{
+            size_t m = 0;
+            for(const auto &info : decoder::kObjects.m_Entries)
+                m = info.m_Size > m ? info.m_Size : m;
+            return m;
+        }();
+        //enough for any schema: every object in a pack of its own
+        static constexpr size_t kMaxArenaSize = MaxObjects * (tools::LayoutEngine<MaxObjects>::kHeaderSize + 1 + kMaxObjectSize);
+
+        RuntimeAdvertisementsList(uint8_t *pArena, size_t arenaSize):
+            m_pArena(pArena),
+            m_ArenaSize(arenaSize)
+        {}
+
+        //pIds: object ids in declaration order; sizeLimit: service data bytes per pack
+        SchemaError init(const uint8_t *pIds, size_t n, size_t sizeLimit, Flags f)
+        {
+            m_Packs = 0;
+            m_Dirty = 0;
+            if (n > MaxObjects)
+                return SchemaError::TooManyObjects;
+
+            uint8_t costs[MaxObjects];
+            for(size_t i = 0; i < n; ++i)
+            {
+                const decoder::ObjectInfo &info = decoder::kObjects[pIds[i]];
+                if (info.m_Kind == decoder::Kind::Unknown)
+                    return SchemaError::UnknownObject;
+                if (info.m_Kind == decoder::Kind::Variable)
+                    return SchemaError::VariableObject;
+                m_Ids[i] = pIds[i];
+                costs[i] = uint8_t(1 + info.m_Size);
+            }
+
+            const auto layout = tools::LayoutEngine<MaxObjects>(m_Ids, costs, n, sizeLimit).compute();
+            if (!layout.m_Fits)
+                return SchemaError::TooBig;
+
+            size_t used = 0;
+            for(size_t p = 0; p < layout.m_Packs; ++p)
+            {
+                m_PackStart[p] = uint16_t(used);
+                used += tools::LayoutEngine<MaxObjects>::kHeaderSize;
+                for(size_t j = layout.m_PackBegin[p]; j < layout.m_PackBegin[p + 1]; ++j)
+                    used += costs[layout.m_Order[j]];
+            }
+            if (used > m_ArenaSize)
+                return SchemaError::ArenaTooSmall;
+            m_PackStart[layout.m_Packs] = uint16_t(used);
+
+            //same bytes AdvertismentSVC(Flags) produces: header and default (zero) values
+            for(size_t p = 0; p < layout.m_Packs; ++p)
+            {
+                uint8_t *pPack = m_pArena + m_PackStart[p];
+                pPack[0] = 0xd2;
+                pPack[1] = 0xfc;
+                pPack[2] = f | kBTHomeVer;
+                for(size_t k = 3; k < pack_size(p); ++k)
+                    pPack[k] = 0;
+            }
+
+            for(auto &first : m_First)
+                first = kNone;
+            for(size_t i = n; i-- > 0;)
+            {
+                m_Locations[i] = layout.m_Locations[i];
+                m_pArena[m_PackStart[m_Locations[i].m_Pack] + m_Locations[i].m_Offset] = m_Ids[i];
+                m_Next[i] = m_First[m_Ids[i]];
+                m_First[m_Ids[i]] = uint8_t(i);
+            }
+
+            m_Objects = n;
+            m_Packs = layout.m_Packs;
+            m_Dirty = m_Packs == 32 ? ~uint32_t(0) : ((uint32_t(1) << m_Packs) - 1);
+            return SchemaError::Ok;
+        }
+
+        //returns true if the encoded bytes changed, false also if the schema has no such object
+        template<class X, class Value>
+        bool update(Value v)
+        {
+            return update_nth<X>(0, v);
+        }
+
+        //nth is 0-based and counts in the order the ids were given to init
+        template<class X, class Value>
+        bool update_nth(size_t nth, Value v)
+        {
+            const uint8_t obj = find(X::kDataId, nth);
+            if (obj == kNone)
+                return false;
+            const tools::ObjectLocation &loc = m_Locations[obj];
+            if (!AdvertismentSVC<X>::template write<X>(v, m_pArena + m_PackStart[loc.m_Pack] + loc.m_Offset + 1))
+                return false;
+            m_Dirty |= uint32_t(1) << loc.m_Pack;
+            return true;
+        }
+
+        bool has(uint8_t id, size_t nth = 0) const { return find(id, nth) != kNone; }
+
+        size_t objects_count() const { return m_Objects; }
+        size_t packs_count() const { return m_Packs; }
+
+        //service data of a pack, ready for BT_DATA_SVC_DATA16
+        const uint8_t* pack_data(size_t p) const { return m_pArena + m_PackStart[p]; }
+        size_t pack_size(size_t p) const { return m_PackStart[p + 1] - m_PackStart[p]; }
+
+        uint32_t dirty_packs() const { return m_Dirty; }
+        void clear_dirty(size_t p) { m_Dirty &= ~(uint32_t(1) << p); }
+
+    private:
+        uint8_t find(uint8_t id, size_t nth) const
+        {
+            uint8_t obj = m_First[id];
+            for(; obj != kNone && nth; --nth)
+                obj = m_Next[obj];
+            return obj;
+        }
+
+        uint8_t *m_pArena;
+        size_t m_ArenaSize;
+        size_t m_Objects = 0;
+        size_t m_Packs = 0;
+        uint32_t m_Dirty = 0;
+        uint8_t m_Ids[MaxObjects];
+        tools::ObjectLocation m_Locations[MaxObjects];
+        uint16_t m_PackStart[MaxObjects + 1];
+        uint8_t m_First[256];//id -> first object with it
+        uint8_t m_Next[MaxObjects];//next object with the same id
+    };
+
+    //owns an arena big enough for any schema of MaxObjects objects
+    template<size_t MaxObjects, size_t ArenaSize = RuntimeAdvertisementsList<MaxObjects>::kMaxArenaSize>
+    struct StaticRuntimeAdvertisementsList: RuntimeAdvertisementsList<MaxObjects>
+    {
+        StaticRuntimeAdvertisementsList():
+            RuntimeAdvertisementsList<MaxObjects>(m_Arena, ArenaSize)
+        {}
+
+        uint8_t m_Arena[ArenaSize];
+    };
+}
+
+#endif
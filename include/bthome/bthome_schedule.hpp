@@ -0,0 +1,113 @@
+#ifndef BTHHOME_SCHEDULE_HPP_
+#define BTHHOME_SCHEDULE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+//Earliest-deadline-first slot scheduler for nodes advertising many devices over one radio.
+//Doesn't depend on zephyr: time is passed in, so it can be simulated on a host.
+namespace BTHome
+{
+    //A device refreshes when all of its packs were on air once; it has to do so once every period.
+    //Every period releases a refresh which is due one period later. Each slot sends one pack
+    //of the released device with the earliest deadline, so every device gets its share
+    //as long as utilization() stays at or below 1000.
+    template<size_t MaxDevices>
+    struct BridgeSchedule
+    {
+        static constexpr size_t kNone = size_t(-1);
+
+        struct Slot
+        {
+            size_t m_Device = kNone;
+            size_t m_Pack = 0;
+        };
+
+        //returns the device index or kNone if full; the first refresh is released right away
+        size_t add(size_t packs, int32_t period_ms, int64_t now_ms)
+        {
+            if (m_Count == MaxDevices || !packs || period_ms <= 0)
+                return kNone;
+            m_Devices[m_Count] = {now_ms, now_ms + period_ms, period_ms, packs, 0, 0, 0};
+            return m_Count++;
+        }
+
+        //slot to send at now_ms for slot_ms; if nothing is released returns kNone in m_Device
+        //and wait_ms receives the time until the next release
+        Slot next(int64_t now_ms, int32_t slot_ms, int64_t &wait_ms)
+        {
+            Device *pBest = nullptr;
+            int64_t nextRelease = INT64_MAX;
+            for(size_t i = 0; i < m_Count; ++i)
+            {
+                Device &d = m_Devices[i];
+                if (d.m_Release > now_ms)
+                {
+                    nextRelease = d.m_Release < nextRelease ? d.m_Release : nextRelease;
+                    continue;
+                }
+                if (!pBest || d.m_Deadline < pBest->m_Deadline)
+                    pBest = &d;
+            }
+            if (!pBest)
+            {
+                wait_ms = m_Count ? nextRelease - now_ms : -1;
+                return {};
+            }
+
+            Device &d = *pBest;
+            const Slot s{size_t(pBest - m_Devices), d.m_NextPack};
+            if (++d.m_NextPack == d.m_Packs)
+            {
+                d.m_NextPack = 0;
+                ++d.m_Refreshes;
+                if (now_ms + slot_ms > d.m_Deadline)
+                    ++d.m_Misses;
+                d.m_Release += d.m_Period;
+                //fallen behind by a whole period: skip the refreshes that can't be made anymore
+                if (d.m_Release + d.m_Period < now_ms)
+                    d.m_Release = now_ms;
+                d.m_Deadline = d.m_Release + d.m_Period;
+            }
+            wait_ms = 0;
+            return s;
+        }
+
+        //slot time demanded per second in permille for slot_ms slots: above 1000 deadlines will be missed
+        uint32_t utilization(int32_t slot_ms) const
+        {
+            uint64_t permille = 0;
+            for(size_t i = 0; i < m_Count; ++i)
+                permille += uint64_t(m_Devices[i].m_Packs) * uint64_t(slot_ms) * 1000 / uint64_t(m_Devices[i].m_Period);
+            return uint32_t(permille);
+        }
+
+        //devices with packs packs and period_ms refresh period one radio sustains
+        static constexpr size_t Capacity(size_t packs, int32_t period_ms, int32_t slot_ms)
+        {
+            return packs && slot_ms > 0 ? size_t(period_ms / (int64_t(packs) * slot_ms)) : 0;
+        }
+
+        size_t devices() const { return m_Count; }
+        uint32_t refreshes(size_t dev) const { return m_Devices[dev].m_Refreshes; }
+        //refreshes completed after their deadline
+        uint32_t misses(size_t dev) const { return m_Devices[dev].m_Misses; }
+
+    private:
+        struct Device
+        {
+            int64_t m_Release;
+            int64_t m_Deadline;
+            int32_t m_Period;
+            size_t m_Packs;
+            size_t m_NextPack;
+            uint32_t m_Refreshes;
+            uint32_t m_Misses;
+        };
+
+        Device m_Devices[MaxDevices]{};
+        size_t m_Count = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,428 @@
+#ifndef BTHHOME_SIM_HPP_
+#define BTHHOME_SIM_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include "bthome_airtime.hpp"
+
+//Discrete event simulation of advertisers rotating their packs and one scanner, 1M PHY.
+//Doesn't depend on zephyr: meant to sweep intervals, slots and scan settings on a host.
+//Overlapping PDUs on the same channel are both lost (no capture effect), scan responses
+//and periodic advertising are not modelled.
+namespace BTHome
+{
+    namespace sim
+    {
+        inline constexpr size_t kNone = size_t(-1);
+        inline constexpr size_t kMaxPacks = 32;
+        inline constexpr size_t kLatencyBins = 256;
+        inline constexpr size_t kMaxProbes = 64;
+        inline constexpr uint32_t kMaxAdvDelayUs = 10000;//advDelay added to every interval
+
+        struct AdvertiserConfig
+        {
+            size_t m_Packs = 1;
+            uint16_t m_AdvDataSize[kMaxPacks]{};//advertising data bytes of every pack
+            bool m_Extended = false;
+            uint32_t m_Interval = 0xa0;//0.625ms units like bt_le_adv_param, 100ms
+            uint32_t m_SlotMs = 1000;//adv_duration_ms: how long every pack is on air
+            uint32_t m_PeriodMs = 0;//a rotation through all the packs starts every period; 0 - back to back
+            uint32_t m_ChannelGapUs = 350;//between the PDUs of an event, controller dependent
+            uint32_t m_AuxOffsetUs = 500;//from the last ADV_EXT_IND to AUX_ADV_IND
+        };
+
+        //AdvertiserConfig with the packs of an Advertisement/ExtAdvertisement as laid out by the library
+        template<class Adv>
+        constexpr AdvertiserConfig MakeAdvertiser(uint32_t interval, uint32_t slot_ms, uint32_t period_ms = 0)
+        {
+            static_assert(Adv::kPacksCount <= kMaxPacks);
+            AdvertiserConfig a;
+            a.m_Packs = Adv::kPacksCount;
+            for(size_t p = 0; p < Adv::kPacksCount; ++p)
+                a.m_AdvDataSize[p] = uint16_t(Adv::adv_data_size(p));
+            a.m_Extended = Adv::OptionsType::kExtended;
+            a.m_Interval = interval;
+            a.m_SlotMs = slot_ms;
+            a.m_PeriodMs = period_ms;
+            return a;
+        }
+
+        struct SimConfig
+        {
+            uint32_t m_ScanInterval = 0x60;//0.625ms units like bt_le_scan_param, 60ms
+            uint32_t m_ScanWindow = 0x60;//== m_ScanInterval: continuous scanning
+            float m_PduLoss = 0.f;//chance to lose a PDU that didn't collide, for the link budget
+            //advertiser clocks are off by up to that much from the scanner's, drawn per advertiser;
+            //without it timer driven slots can stay locked to one scan phase for the whole run
+            uint32_t m_ClockPpm = 50;
+            //a state change to measure the time to full state from, on average; the spacing is drawn from
+            //0.5-1.5x of it so the changes don't stay locked to one phase of a rotation with a multiple of it
+            uint32_t m_ProbeEveryMs = 1000;
+            uint32_t m_LatencyBinMs = 100;//latencies above kLatencyBins bins are timeouts
+            uint64_t m_Seed = 1;
+        };
+
+        struct PackStats
+        {
+            uint32_t m_Events = 0;//advertising events sent
+            uint32_t m_Received = 0;//events the scanner got
+            uint32_t m_Collided = 0;//events lost to a collision on the channel being scanned
+            uint32_t m_Slots = 0;
+            uint32_t m_SlotsReceived = 0;//slots with at least one event received
+
+            float reception() const { return m_Events ? float(m_Received) / float(m_Events) : 0.f; }
+            float slot_reception() const { return m_Slots ? float(m_SlotsReceived) / float(m_Slots) : 0.f; }
+        };
+
+        //time from a state change until every pack advertised after it was received once
+        struct LatencyStats
+        {
+            uint32_t m_Bins[kLatencyBins]{};
+            uint32_t m_BinMs = 1;
+            uint32_t m_Count = 0;
+            uint32_t m_Timeouts = 0;
+            uint32_t m_Dropped = 0;//state changes not measured, more than kMaxProbes were pending
+            uint64_t m_SumUs = 0;
+
+            //upper bound of the latency of q (0..1) of the state changes, UINT32_MAX if that's a timeout
+            uint32_t percentile_ms(float q) const
+            {
+                const uint64_t total = uint64_t(m_Count) + m_Timeouts;
+                if (!total)
+                    return 0;
+                uint64_t target = uint64_t(q * float(total) + 0.999f);
+                target = target ? target : 1;
+                uint64_t seen = 0;
+                for(size_t i = 0; i < kLatencyBins; ++i)
+                {
+                    seen += m_Bins[i];
+                    if (seen >= target)
+                        return uint32_t(i + 1) * m_BinMs;
+                }
+                return UINT32_MAX;
+            }
+
+            //of the state changes completed within the histogram
+            float mean_ms() const { return m_Count ? float(m_SumUs) / float(m_Count) / 1000.f : 0.f; }
+        };
+
+        template<size_t MaxAdvertisers>
+        struct ReceptionSim
+        {
+            ReceptionSim(SimConfig cfg = {}):
+                m_Config(cfg),
+                m_Rng(cfg.m_Seed)
+            {}
+
+            //returns the advertiser index or kNone if full or the configuration is invalid
+            size_t add(const AdvertiserConfig &a)
+            {
+                if (m_Count == MaxAdvertisers || !a.m_Packs || a.m_Packs > kMaxPacks || a.m_Interval < 0x20 || !a.m_SlotMs)
+                    return kNone;
+                m_Advertisers[m_Count].m_Config = a;
+                return m_Count++;
+            }
+
+            //simulates duration_ms from scratch; every run continues the random sequence
+            void run(uint32_t duration_ms)
+            {
+                const int64_t endUs = int64_t(duration_ms) * 1000;
+                m_ScanPhaseUs = uniform(3 * m_Config.m_ScanInterval * 625);
+                m_PendingBegin = m_PendingCount = 0;
+                for(size_t i = 0; i < m_Count; ++i)
+                    reset(m_Advertisers[i]);
+
+                for(;;)
+                {
+                    Advertiser *pNext = earliest();
+                    if (!pNext || pNext->m_NextUs >= endUs)
+                        break;
+                    send_event(*pNext);
+                    pNext = earliest();
+                    //no later event starts before the earliest next one, so anything that ended by then is settled
+                    while(m_PendingCount && m_Pending[m_PendingBegin].m_EndUs <= pNext->m_NextUs)
+                        settle();
+                }
+                while(m_PendingCount)
+                    settle();
+                for(size_t i = 0; i < m_Count; ++i)
+                    advance_probes(m_Advertisers[i], endUs, true);
+            }
+
+            size_t advertisers() const { return m_Count; }
+            const PackStats& pack(size_t adv, size_t p) const { return m_Advertisers[adv].m_Packs[p]; }
+            const LatencyStats& latency(size_t adv) const { return m_Advertisers[adv].m_Latency; }
+
+        private:
+            struct Pdu
+            {
+                int64_t m_StartUs;
+                uint32_t m_Us;
+                uint8_t m_Channel;//0-36 secondary, 37-39 primary
+                bool m_Collided;
+            };
+
+            struct Event
+            {
+                Pdu m_Pdus[airtime::kAdvChannels + 1];
+                uint8_t m_PduCount;
+                bool m_Extended;
+                size_t m_Adv;
+                size_t m_Pack;
+                uint32_t m_Slot;
+                int64_t m_EndUs;
+            };
+
+            struct Probe
+            {
+                int64_t m_AtUs;
+                uint32_t m_Mask;
+            };
+
+            struct Advertiser
+            {
+                AdvertiserConfig m_Config;
+                int64_t m_NextUs;
+                int64_t m_CycleUs;
+                int64_t m_SlotEndUs;
+                size_t m_Pack;
+                uint32_t m_Slot;
+                uint32_t m_LastSlotReceived[kMaxPacks];
+                PackStats m_Packs[kMaxPacks];
+                LatencyStats m_Latency;
+                int32_t m_ClockPpm;
+                Probe m_Probes[kMaxProbes];
+                size_t m_ProbeBegin;
+                size_t m_ProbeCount;
+                int64_t m_NextProbeUs;
+            };
+
+            static constexpr size_t kPending = MaxAdvertisers * 4 + 4;
+
+            uint64_t random()
+            {
+                //splitmix64
+                uint64_t z = (m_Rng += 0x9e3779b97f4a7c15ull);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                return z ^ (z >> 31);
+            }
+
+            //0..n-1
+            uint32_t uniform(uint32_t n) { return uint32_t(((random() >> 32) * n) >> 32); }
+            float unit() { return float(random() >> 40) * (1.f / float(1 << 24)); }
+
+            static uint32_t rotation_ms(const AdvertiserConfig &c) { return uint32_t(c.m_Packs) * c.m_SlotMs; }
+
+            //a duration timed by the advertiser in scanner time
+            static int64_t local_us(const Advertiser &a, int64_t us) { return us + us * a.m_ClockPpm / 1000000; }
+
+            void reset(Advertiser &a)
+            {
+                const AdvertiserConfig &c = a.m_Config;
+                const uint32_t cycleMs = c.m_PeriodMs > rotation_ms(c) ? c.m_PeriodMs : rotation_ms(c);
+                a.m_Pack = 0;
+                a.m_Slot = 0;
+                for(size_t p = 0; p < kMaxPacks; ++p)
+                {
+                    a.m_Packs[p] = {};
+                    a.m_LastSlotReceived[p] = UINT32_MAX;
+                }
+                a.m_Latency = {};
+                a.m_Latency.m_BinMs = m_Config.m_LatencyBinMs ? m_Config.m_LatencyBinMs : 1;
+                a.m_ProbeBegin = a.m_ProbeCount = 0;
+                a.m_ClockPpm = int32_t(uniform(2 * m_Config.m_ClockPpm + 1)) - int32_t(m_Config.m_ClockPpm);
+                //random phase so advertisers don't start in lockstep
+                a.m_CycleUs = int64_t(uniform(cycleMs)) * 1000 + uniform(1000);
+                start_slot(a, a.m_CycleUs);
+                a.m_NextProbeUs = a.m_CycleUs + uniform(m_Config.m_ProbeEveryMs * 1000 + 1);
+            }
+
+            void start_slot(Advertiser &a, int64_t atUs)
+            {
+                a.m_SlotEndUs = atUs + local_us(a, int64_t(a.m_Config.m_SlotMs) * 1000);
+                a.m_NextUs = atUs + uniform(kMaxAdvDelayUs + 1);
+                ++a.m_Slot;
+                ++a.m_Packs[a.m_Pack].m_Slots;
+            }
+
+            Advertiser* earliest()
+            {
+                Advertiser *pBest = nullptr;
+                for(size_t i = 0; i < m_Count; ++i)
+                    if (!pBest || m_Advertisers[i].m_NextUs < pBest->m_NextUs)
+                        pBest = &m_Advertisers[i];
+                return pBest;
+            }
+
+            void send_event(Advertiser &a)
+            {
+                if (m_PendingCount == kPending)
+                    settle();
+                const AdvertiserConfig &c = a.m_Config;
+                Event &e = m_Pending[(m_PendingBegin + m_PendingCount++) % kPending];
+                e.m_Adv = size_t(&a - m_Advertisers);
+                e.m_Pack = a.m_Pack;
+                e.m_Slot = a.m_Slot;
+                e.m_Extended = c.m_Extended;
+                e.m_PduCount = 0;
+                const size_t dataSize = c.m_AdvDataSize[a.m_Pack];
+                const uint32_t primaryUs = c.m_Extended ? airtime::kExtIndUs : airtime::LegacyPduUs(dataSize);
+                int64_t t = a.m_NextUs;
+                for(uint8_t ch = 0; ch < airtime::kAdvChannels; ++ch)
+                {
+                    e.m_Pdus[e.m_PduCount++] = {t, primaryUs, uint8_t(37 + ch), false};
+                    t += primaryUs + c.m_ChannelGapUs;
+                }
+                e.m_EndUs = t - c.m_ChannelGapUs;
+                if (c.m_Extended)
+                {
+                    const int64_t auxUs = e.m_EndUs + c.m_AuxOffsetUs;
+                    e.m_Pdus[e.m_PduCount++] = {auxUs, airtime::AuxPduUs(dataSize), uint8_t(uniform(37)), false};
+                    e.m_EndUs = auxUs + airtime::AuxPduUs(dataSize);
+                }
+                ++a.m_Packs[a.m_Pack].m_Events;
+                collide(e);
+
+                a.m_NextUs += local_us(a, int64_t(c.m_Interval) * 625) + uniform(kMaxAdvDelayUs + 1);
+                if (a.m_NextUs < a.m_SlotEndUs)
+                    return;
+                //next pack; after the last one the next rotation starts with the period or right away
+                int64_t nextSlotUs = a.m_SlotEndUs;
+                if (++a.m_Pack == c.m_Packs)
+                {
+                    a.m_Pack = 0;
+                    a.m_CycleUs += local_us(a, int64_t(c.m_PeriodMs) * 1000);
+                    nextSlotUs = a.m_CycleUs > nextSlotUs ? a.m_CycleUs : nextSlotUs;
+                    a.m_CycleUs = nextSlotUs;
+                }
+                start_slot(a, nextSlotUs);
+            }
+
+            void collide(Event &e)
+            {
+                const int64_t startUs = e.m_Pdus[0].m_StartUs;
+                for(size_t i = 0; i + 1 < m_PendingCount; ++i)
+                {
+                    Event &o = m_Pending[(m_PendingBegin + i) % kPending];
+                    if (o.m_Adv == e.m_Adv || o.m_EndUs <= startUs)
+                        continue;
+                    for(uint8_t j = 0; j < e.m_PduCount; ++j)
+                        for(uint8_t k = 0; k < o.m_PduCount; ++k)
+                        {
+                            Pdu &a = e.m_Pdus[j];
+                            Pdu &b = o.m_Pdus[k];
+                            if (a.m_Channel == b.m_Channel && a.m_StartUs < b.m_StartUs + b.m_Us && b.m_StartUs < a.m_StartUs + a.m_Us)
+                                a.m_Collided = b.m_Collided = true;
+                        }
+                }
+            }
+
+            //whether the scanner is on the PDU's primary channel for all of it
+            bool scanned(const Pdu &pdu) const
+            {
+                const int64_t intervalUs = int64_t(m_Config.m_ScanInterval) * 625;
+                const int64_t t = pdu.m_StartUs + m_ScanPhaseUs;
+                const int64_t inWindow = t % intervalUs;
+                return pdu.m_Channel == 37 + (t / intervalUs) % 3 && inWindow + pdu.m_Us <= int64_t(m_Config.m_ScanWindow) * 625;
+            }
+
+            void settle()
+            {
+                const Event &e = m_Pending[m_PendingBegin];
+                m_PendingBegin = (m_PendingBegin + 1) % kPending;
+                --m_PendingCount;
+
+                bool received = false, collided = false;
+                for(uint8_t i = 0; i < airtime::kAdvChannels; ++i)
+                {
+                    const Pdu &pdu = e.m_Pdus[i];
+                    if (!scanned(pdu))
+                        continue;
+                    collided |= pdu.m_Collided;
+                    received |= !pdu.m_Collided && unit() >= m_Config.m_PduLoss;
+                }
+                if (received && e.m_Extended)
+                {
+                    //the scanner follows the AuxPtr whatever it scans at the time
+                    const Pdu &aux = e.m_Pdus[airtime::kAdvChannels];
+                    collided |= aux.m_Collided;
+                    received = !aux.m_Collided && unit() >= m_Config.m_PduLoss;
+                }
+
+                Advertiser &a = m_Advertisers[e.m_Adv];
+                PackStats &s = a.m_Packs[e.m_Pack];
+                if (collided && !received)
+                    ++s.m_Collided;
+                advance_probes(a, e.m_Pdus[0].m_StartUs, false);
+                if (!received)
+                    return;
+                ++s.m_Received;
+                if (a.m_LastSlotReceived[e.m_Pack] != e.m_Slot)
+                {
+                    a.m_LastSlotReceived[e.m_Pack] = e.m_Slot;
+                    ++s.m_SlotsReceived;
+                }
+
+                //a probe older than another has seen all its receptions too, so they complete in order
+                const uint32_t all = a.m_Config.m_Packs == 32 ? ~uint32_t(0) : ((uint32_t(1) << a.m_Config.m_Packs) - 1);
+                for(size_t i = 0; i < a.m_ProbeCount; ++i)
+                    a.m_Probes[(a.m_ProbeBegin + i) % kMaxProbes].m_Mask |= uint32_t(1) << e.m_Pack;
+                while(a.m_ProbeCount && a.m_Probes[a.m_ProbeBegin].m_Mask == all)
+                {
+                    const int64_t us = e.m_EndUs - a.m_Probes[a.m_ProbeBegin].m_AtUs;
+                    const size_t bin = size_t(us / (int64_t(a.m_Latency.m_BinMs) * 1000));
+                    if (bin < kLatencyBins)
+                    {
+                        ++a.m_Latency.m_Bins[bin];
+                        ++a.m_Latency.m_Count;
+                        a.m_Latency.m_SumUs += uint64_t(us);
+                    }
+                    else
+                        ++a.m_Latency.m_Timeouts;
+                    pop_probe(a);
+                }
+            }
+
+            //opens the state changes up to nowUs (only events starting after one carry it) and times out old ones
+            void advance_probes(Advertiser &a, int64_t nowUs, bool final)
+            {
+                LatencyStats &l = a.m_Latency;
+                const int64_t maxUs = int64_t(kLatencyBins) * l.m_BinMs * 1000;
+                const int64_t everyUs = int64_t(m_Config.m_ProbeEveryMs ? m_Config.m_ProbeEveryMs : 1) * 1000;
+                for(; a.m_NextProbeUs <= nowUs; a.m_NextProbeUs += everyUs / 2 + uniform(uint32_t(everyUs) + 1))
+                {
+                    if (a.m_ProbeCount == kMaxProbes)
+                        ++l.m_Dropped;
+                    else
+                        a.m_Probes[(a.m_ProbeBegin + a.m_ProbeCount++) % kMaxProbes] = {a.m_NextProbeUs, 0};
+                }
+                while(a.m_ProbeCount && nowUs - a.m_Probes[a.m_ProbeBegin].m_AtUs > maxUs)
+                {
+                    ++l.m_Timeouts;
+                    pop_probe(a);
+                }
+                //the ones still within the limit at the end of the run are undecided
+                if (final)
+                    a.m_ProbeCount = 0;
+            }
+
+            static void pop_probe(Advertiser &a)
+            {
+                a.m_ProbeBegin = (a.m_ProbeBegin + 1) % kMaxProbes;
+                --a.m_ProbeCount;
+            }
+
+            SimConfig m_Config;
+            uint64_t m_Rng;
+            int64_t m_ScanPhaseUs = 0;
+            Advertiser m_Advertisers[MaxAdvertisers]{};
+            size_t m_Count = 0;
+            Event m_Pending[kPending]{};
+            size_t m_PendingBegin = 0;
+            size_t m_PendingCount = 0;
+        };
+    }
+}
+
+#endif
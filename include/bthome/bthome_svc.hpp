@@ -0,0 +1,129 @@
+#ifndef BTHHOME_SVC_HPP_
+#define BTHHOME_SVC_HPP_
+
+#include "bthome_tools.hpp"
+#include "bthome_types.hpp"
+
+//BTHome service data for a set of data types.
+//Doesn't depend on zephyr so it can be built and inspected on a host.
+namespace BTHome
+{
+    template<class... T> requires (IsBTHomeDataType<T> &&...)
+    struct AdvertismentSVC
+    {
+
+        static const constexpr size_t kSVCDataSize = 
+            2 /*ID 0xd2fc*/
+            + 1 /*flags*/
+            + sizeof...(T)//1 byte for data type
+            + (T::kDataSize + ...)//however many bytes for actual types
+        ;
+
+        using LastType = tools::NthType<sizeof...(T) - 1, T...>;
+        static_assert((kIsVariable<T> + ...) == 0 || ((kIsVariable<T> + ...) == 1 && kIsVariable<LastType>), "A variable length object must be the only one and the last one");
+
+        //bytes actually advertised: a variable length object only counts its current length
+        static constexpr size_t used_size(const uint8_t *pSVCData)
+        {
+            if constexpr (kIsVariable<LastType>)
+                return kSVCDataSize - LastType::kMaxLen + pSVCData[kSVCDataSize - LastType::kDataSize];
+            else
+                return kSVCDataSize;
+        }
+
+        constexpr size_t size() const { return used_size(m_SVCData); }
+
+        constexpr AdvertismentSVC(Flags f):
+            m_SVCData{0xd2, 0xfc, f | kBTHomeVer, 0}
+        {
+            size_t off = 3;
+            auto fill = [&](auto d)
+            {
+                d.fill(m_SVCData + off);
+                off += 1 + d.kDataSize;
+            };
+            (fill(T()/*defaults*/),...);
+        }
+
+        constexpr AdvertismentSVC(Flags f, T... data):
+            m_SVCData{0xd2, 0xfc, f | kBTHomeVer, 0}
+        {
+            size_t off = 3;
+            auto fill = [&](auto d)
+            {
+                d.fill(m_SVCData + off);
+                off += 1 + d.kDataSize;
+            };
+            (fill(data),...);
+        }
+
+        //offset of the idx-th object (its id byte) inside m_SVCData
+        static constexpr size_t offset_of(size_t idx)
+        {
+            constexpr uint8_t sizes[] = {T::kDataSize...};
+            size_t off = 3;
+            for(size_t i = 0; i < idx; ++i)
+                off += 1 + sizes[i];
+            return off;
+        }
+
+        //returns true if the encoded bytes actually changed
+        template<class X, class Value>
+        bool update(Value v)
+        {
+            return update_nth<X, 0, Value>(v);
+        }
+
+        template<class X, size_t Nth, class Value>
+        bool update_nth(Value v)
+        {
+            constexpr size_t kIdx = tools::FindNth<X, Nth, T...>();
+            static_assert(kIdx != tools::kNotFound, "Data type not found");
+            constexpr size_t kOffset = offset_of(kIdx);
+            return write<X>(v, m_SVCData + kOffset + 1);
+        }
+
+        //v is in units of X::kFactor, e.g. centi-degrees for Temperature
+        template<class X>
+        bool update_scaled(int32_t v)
+        {
+            return update_nth<X, 0>(Scaled{v});
+        }
+
+        template<class X, size_t Nth>
+        bool update_scaled_nth(int32_t v)
+        {
+            return update_nth<X, Nth>(Scaled{v});
+        }
+
+        template<class X, class Value>
+        static bool write(Value v, uint8_t *pDst)
+        {
+            if constexpr (kIsVariable<X>)
+                return X::write_to(v, pDst);//straight into the pack
+            else if constexpr (requires { X::encode(v, pDst); })
+                return X::encode(v, pDst);//shared kernel, in place
+            else
+            {
+                uint8_t encoded[X::kDataSize];
+                X::convert_from(v, encoded);
+                bool changed = false;
+                for(size_t i = 0; i < X::kDataSize; ++i)
+                {
+                    changed |= pDst[i] != encoded[i];
+                    pDst[i] = encoded[i];
+                }
+                return changed;
+            }
+        }
+
+        uint8_t m_SVCData[kSVCDataSize];
+    };
+
+    template<class... T> requires (IsBTHomeDataType<T> &&...)
+    AdvertismentSVC(Flags, T...) -> AdvertismentSVC<T...>;
+    template<class... T> requires (IsBTHomeDataType<T> &&...)
+    AdvertismentSVC(T...) -> AdvertismentSVC<T...>;
+}
+
+#endif
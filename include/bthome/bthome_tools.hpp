@@ -3,6 +3,8 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <type_traits>
+#include <utility>
 
 namespace BTHome
 {
@@ -18,37 +20,41 @@ namespace BTHome
 
     namespace tools
     {
-        template<size_t Nth, class X, class... T>
-        struct DataOffset;
-
-        template<size_t Nth, class X, class... T>
-            struct DataOffset<Nth, X, X, T...>
-            {
-                static constexpr uint8_t kOffset = X::kDataSize + 1 + DataOffset<Nth - 1, X, T...>::kOffset;
-                static constexpr bool kFound = DataOffset<Nth - 1, X, T...>::kFound;
-            };
-
-        template<class X, class... T>
-            struct DataOffset<1, X, X, T...>
-            {
-                static constexpr uint8_t kOffset = 0;
-                static constexpr bool kFound = true;
-            };
-
-        template<size_t Nth, class X, class Y, class... T>
-            struct DataOffset<Nth, X, Y, T...>
-            {
-                static constexpr uint8_t kOffset = Y::kDataSize + 1 + DataOffset<Nth, X, T...>::kOffset;
-                static constexpr bool kFound = DataOffset<Nth, X, T...>::kFound;
-            };
-
-        template<size_t Nth, class X>
-            struct DataOffset<Nth, X>
-            {
-                static constexpr uint8_t kOffset = 0xff;
-                static constexpr bool kFound = false;
-            };
-
+        template<class... T>
+        struct TypeList
+        {
+            static constexpr size_t kSize = sizeof...(T);
+        };
+
+        template<size_t I, class T>
+        struct IndexedType { using type = T; };
+
+        template<class Seq, class... T>
+        struct IndexedTypes;
+
+        template<size_t... I, class... T>
+        struct IndexedTypes<std::index_sequence<I...>, T...>: IndexedType<I, T>... {};
+
+        template<size_t I, class T>
+        IndexedType<I, T> SelectIndexed(IndexedType<I, T>);
+
+        //I-th type of the pack without recursive instantiation
+        template<size_t I, class... T>
+        using NthType = typename decltype(SelectIndexed<I>(IndexedTypes<std::index_sequence_for<T...>, T...>{}))::type;
+
+        inline constexpr size_t kNotFound = size_t(-1);
+
+        //index of the Nth (0-based) occurrence of X in T... or kNotFound
+        template<class X, size_t Nth, class... T>
+        consteval size_t FindNth()
+        {
+            constexpr bool same[] = {std::is_same_v<X, T>..., false};
+            size_t n = Nth;
+            for(size_t i = 0; i < sizeof...(T); ++i)
+                if (same[i] && n-- == 0)
+                    return i;
+            return kNotFound;
+        }
     }
 }
 #endif
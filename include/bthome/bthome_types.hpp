@@ -30,74 +30,144 @@ namespace BTHome
     };
 
     struct bth_type_t {using bth_type_tag = void;};
-    struct bth_uint8_t :bth_type_t{ using real_t = uint8_t; uint8_t d; };
-    struct bth_uint16_t:bth_type_t{ using real_t = uint16_t; uint8_t d[2]; };
-    struct bth_uint24_t:bth_type_t{ using real_t = uint32_t; uint8_t d[3]; };
-    struct bth_uint32_t:bth_type_t{ using real_t = uint32_t; uint8_t d[4]; };
+    struct bth_uint8_t :bth_type_t{ using real_t = uint8_t; static constexpr bool kSigned = false; uint8_t d; };
+    struct bth_uint16_t:bth_type_t{ using real_t = uint16_t; static constexpr bool kSigned = false; uint8_t d[2]; };
+    struct bth_uint24_t:bth_type_t{ using real_t = uint32_t; static constexpr bool kSigned = false; uint8_t d[3]; };
+    struct bth_uint32_t:bth_type_t{ using real_t = uint32_t; static constexpr bool kSigned = false; uint8_t d[4]; };
 
-    struct bth_sint8_t :bth_type_t{ using real_t = int8_t; int8_t d; };
-    struct bth_sint16_t:bth_type_t{ using real_t = int16_t; int8_t d[2]; };
-    struct bth_sint24_t:bth_type_t{ using real_t = int32_t; int8_t d[3]; };
-    struct bth_sint32_t:bth_type_t{ using real_t = int32_t; int8_t d[4]; };
+    struct bth_sint8_t :bth_type_t{ using real_t = int8_t; static constexpr bool kSigned = true; int8_t d; };
+    struct bth_sint16_t:bth_type_t{ using real_t = int16_t; static constexpr bool kSigned = true; int8_t d[2]; };
+    struct bth_sint24_t:bth_type_t{ using real_t = int32_t; static constexpr bool kSigned = true; int8_t d[3]; };
+    struct bth_sint32_t:bth_type_t{ using real_t = int32_t; static constexpr bool kSigned = true; int8_t d[4]; };
 
     template<class T>
     concept IsBTHomeType = requires { typename T::bth_type_tag; };
 
-    template<uint8_t Id, IsBTHomeType DataType, float f>
-    struct FloatData: Data<Id, sizeof(DataType), FloatData<Id, DataType, f>>
+    namespace tools
     {
-        using Parent = Data<Id, sizeof(DataType), FloatData<Id, DataType, f>>;
-        constexpr FloatData(float t = {}):Parent(t){}
+        //Encode kernels shared by all the numeric types: the wire size, signedness and factor are arguments
+        //(constants at every call site), so each object type costs a call instead of its own loops.
+        //They store in place and return whether the bytes changed.
+        constexpr int64_t EncodedMin(uint8_t size, bool sign) { return sign ? -(int64_t(1) << (size * 8 - 1)) : 0; }
+        constexpr int64_t EncodedMax(uint8_t size, bool sign) { return sign ? (int64_t(1) << (size * 8 - 1)) - 1 : (int64_t(1) << (size * 8)) - 1; }
+
+        constexpr uint32_t SaturateInt(int32_t v, uint8_t size, bool sign)
+        {
+            const int64_t min = EncodedMin(size, sign), max = EncodedMax(size, sign);
+            return uint32_t(v < min ? min : v > max ? max : v);
+        }
+
+        //rounds half away from zero, NaN becomes 0
+        constexpr uint32_t SaturateFloat(float v, uint8_t size, bool sign)
+        {
+            const int64_t min = EncodedMin(size, sign), max = EncodedMax(size, sign);
+            if (v != v) return 0;
+            if (!(v > float(min))) return uint32_t(min);
+            if (!(v < float(max))) return uint32_t(max);
+            return uint32_t(int64_t(v + (v < 0 ? -0.5f : 0.5f)));
+        }
 
-        static constexpr void convert_from(float t, uint8_t *pDst)
+        //little-endian, the low size bytes of v
+        [[gnu::noinline]] constexpr bool EncodeRaw(uint32_t v, uint8_t size, uint8_t *pDst)
         {
-            uint32_t v = uint32_t(t * f);
-            for(uint8_t i  = 0; i < sizeof(DataType); ++i)
+            bool changed = false;
+            for(uint8_t i = 0; i < size; ++i)
             {
-                pDst[i] = v & 0xff;
+                changed |= pDst[i] != uint8_t(v);
+                pDst[i] = uint8_t(v);
                 v >>= 8;
             }
+            return changed;
         }
+
+        [[gnu::noinline]] constexpr bool EncodeInt(int32_t v, uint8_t size, bool sign, uint8_t *pDst)
+        {
+            return EncodeRaw(SaturateInt(v, size, sign), size, pDst);
+        }
+
+        [[gnu::noinline]] constexpr bool EncodeFloat(float v, float factor, uint8_t size, bool sign, uint8_t *pDst)
+        {
+            return EncodeRaw(SaturateFloat(v * factor, size, sign), size, pDst);
+        }
+    }
+
+    //little-endian encoding of a wire type, saturated to its range
+    template<IsBTHomeType DataType>
+    struct Encoding
+    {
+        static constexpr int64_t kMin = tools::EncodedMin(sizeof(DataType), DataType::kSigned);
+        static constexpr int64_t kMax = tools::EncodedMax(sizeof(DataType), DataType::kSigned);
+
+        static constexpr uint32_t saturate(int32_t v) { return tools::SaturateInt(v, sizeof(DataType), DataType::kSigned); }
+        static constexpr uint32_t saturate(float v) { return tools::SaturateFloat(v, sizeof(DataType), DataType::kSigned); }
+        static constexpr void store(uint32_t v, uint8_t *pDst) { tools::EncodeRaw(v, sizeof(DataType), pDst); }
+    };
+
+    //value already multiplied by the type's factor: Scaled{-550} for Temperature is -5.50
+    //encodes with integer math only, no soft-float on FPU-less MCUs
+    struct Scaled { int32_t m_Value; };
+
+    //wire value as is: only the low bytes are sent, so running totals wrap around at the wire width
+    struct RawValue { uint32_t m_Value; };
+
+    template<uint8_t Id, IsBTHomeType DataType, float f>
+    struct FloatData: Data<Id, sizeof(DataType), FloatData<Id, DataType, f>>
+    {
+        using Parent = Data<Id, sizeof(DataType), FloatData<Id, DataType, f>>;
+        static constexpr float kFactor = f;
+        static constexpr bool kSigned = DataType::kSigned;
+        constexpr FloatData(float t = {}):Parent(t){}
+        constexpr FloatData(Scaled t):Parent(t){}
+        constexpr FloatData(RawValue t):Parent(t){}
+
+        //in place, returns true if the bytes changed
+        static constexpr bool encode(float t, uint8_t *pDst) { return tools::EncodeFloat(t, f, sizeof(DataType), kSigned, pDst); }
+        static constexpr bool encode(Scaled t, uint8_t *pDst) { return tools::EncodeInt(t.m_Value, sizeof(DataType), kSigned, pDst); }
+        static constexpr bool encode(RawValue t, uint8_t *pDst) { return tools::EncodeRaw(t.m_Value, sizeof(DataType), pDst); }
+
+        static constexpr void convert_from(float t, uint8_t *pDst) { encode(t, pDst); }
+        static constexpr void convert_from(Scaled t, uint8_t *pDst) { encode(t, pDst); }
+        static constexpr void convert_from(RawValue t, uint8_t *pDst) { encode(t, pDst); }
     };
 
     template<uint8_t Id, IsBTHomeType DataType>
     struct IntData: Data<Id, sizeof(DataType), IntData<Id, DataType>>
     {
         using Parent = Data<Id, sizeof(DataType), IntData<Id, DataType>>;
+        static constexpr float kFactor = 1.f;
+        static constexpr bool kSigned = DataType::kSigned;
         constexpr IntData(DataType::real_t t = {}):Parent(t){}
+        constexpr IntData(RawValue t):Parent(t){}
 
-        static constexpr void convert_from(DataType::real_t v, uint8_t *pDst)
-        {
-            for(uint8_t i  = 0; i < sizeof(DataType); ++i)
-            {
-                pDst[i] = v & 0xff;
-                v >>= 8;
-            }
-        }
+        //wraps like the integer conversion would
+        static constexpr bool encode(DataType::real_t v, uint8_t *pDst) { return tools::EncodeRaw(uint32_t(v), sizeof(DataType), pDst); }
+        static constexpr bool encode(RawValue v, uint8_t *pDst) { return tools::EncodeRaw(v.m_Value, sizeof(DataType), pDst); }
+        static constexpr void convert_from(DataType::real_t v, uint8_t *pDst) { encode(v, pDst); }
+        static constexpr void convert_from(RawValue v, uint8_t *pDst) { encode(v, pDst); }
     };
 
     template<uint8_t Id, class Binary = bool>
     struct BinaryData: Data<Id, 1, BinaryData<Id, Binary>>
     {
         using Parent = Data<Id, 1, BinaryData<Id, Binary>>;
+        static constexpr float kFactor = 1.f;
+        static constexpr bool kSigned = false;
         constexpr BinaryData(Binary t):Parent(t){}
 
-        static constexpr void convert_from(Binary v, uint8_t *pDst)
-        {
-            pDst[0] = bool(v) ? 1 : 0;
-        }
+        static constexpr bool encode(Binary v, uint8_t *pDst) { return tools::EncodeRaw(bool(v) ? 1 : 0, 1, pDst); }
+        static constexpr void convert_from(Binary v, uint8_t *pDst) { encode(v, pDst); }
     };
 
     template<uint8_t Id, class EData>
     struct EnumData: Data<Id, 1, EnumData<Id, EData>>
     {
         using Parent = Data<Id, 1, EnumData<Id, EData>>;
+        static constexpr float kFactor = 1.f;
+        static constexpr bool kSigned = false;
         constexpr EnumData(EData t = {}):Parent(t){}
 
-        static constexpr void convert_from(EData v, uint8_t *pDst)
-        {
-            pDst[0] = uint8_t(v);
-        }
+        static constexpr bool encode(EData v, uint8_t *pDst) { return tools::EncodeRaw(uint8_t(v), 1, pDst); }
+        static constexpr void convert_from(EData v, uint8_t *pDst) { encode(v, pDst); }
     };
 
     struct Acceleration:       FloatData<0x51/*Id*/, bth_uint16_t, 1000.f/*Factor*/> { using FloatData::FloatData; };
@@ -116,7 +186,7 @@ namespace BTHome
     struct CurrentSigned:      FloatData<0x5D/*Id*/, bth_sint16_t, 1000.f/*Factor*/> { using FloatData::FloatData; };
     struct Dewpoint:           FloatData<0x08/*Id*/, bth_uint16_t, 100.f/*Factor*/> { using FloatData::FloatData; };
     struct Direction:          FloatData<0x5e/*Id*/, bth_sint16_t, 100.f/*Factor*/> { using FloatData::FloatData; };
-    struct DistanceMM:           IntData<0x41/*Id*/, bth_uint16_t> { using IntData::IntData; };
+    struct DistanceMM:           IntData<0x40/*Id*/, bth_uint16_t> { using IntData::IntData; };
     struct DistanceM:          FloatData<0x41/*Id*/, bth_uint16_t, 10.f/*Factor*/> { using FloatData::FloatData; };
     struct Duration:           FloatData<0x42/*Id*/, bth_uint24_t, 1000.f/*Factor*/> { using FloatData::FloatData; };
     struct Energy:             FloatData<0x4D/*Id*/, bth_uint32_t, 1000.f/*Factor*/> { using FloatData::FloatData; };
@@ -157,7 +227,72 @@ namespace BTHome
     struct UVIndex:            FloatData<0x46/*Id*/, bth_uint8_t, 10.f/*Factor*/> { using FloatData::FloatData; };
     struct Water:              FloatData<0x4F/*Id*/, bth_uint32_t, 1000.f/*Factor*/> { using FloatData::FloatData; };
 
-    //TODO: raw, text
+    //variable length objects: a length byte and up to MaxLen bytes.
+    //Packs reserve MaxLen but only advertise the used part, so such an object always goes last
+    //in its pack and a pack holds at most one of them.
+    template<uint8_t Id, uint8_t MaxLen>
+    struct VarData
+    {
+        static const constexpr uint8_t kDataId = Id;
+        static const constexpr uint8_t kDataSize = 1/*length*/ + MaxLen;
+        static const constexpr uint8_t kMaxLen = MaxLen;
+        static const constexpr bool kVariable = true;
+
+        constexpr void fill(uint8_t *pDst) const
+        {
+            pDst[0] = Id;
+            for(size_t i = 1; i < (kDataSize + 1); ++i)
+                pDst[i] = 0;
+        }
+
+        //pDst points at the length byte inside the pack; longer input is cut at MaxLen
+        //returns true if the advertised bytes changed
+        template<class Byte>
+        static constexpr bool write_to(const Byte *pSrc, size_t len, uint8_t *pDst)
+        {
+            if (len > MaxLen)
+                len = MaxLen;
+            bool changed = pDst[0] != len;
+            pDst[0] = uint8_t(len);
+            for(size_t i = 0; i < len; ++i)
+            {
+                changed |= pDst[1 + i] != uint8_t(pSrc[i]);
+                pDst[1 + i] = uint8_t(pSrc[i]);
+            }
+            return changed;
+        }
+    };
+
+    template<class T>
+    constexpr bool kIsVariable = requires { requires T::kVariable; };
+
+    struct BytesView
+    {
+        const uint8_t *m_pData;
+        size_t m_Size;
+    };
+
+    //utf-8, not 0-terminated on air
+    template<uint8_t MaxLen>
+    struct Text: VarData<0x53, MaxLen>
+    {
+        static constexpr bool write_to(const char *pStr, uint8_t *pDst)
+        {
+            size_t len = 0;
+            while(len < MaxLen && pStr[len])
+                ++len;
+            return VarData<0x53, MaxLen>::write_to(pStr, len, pDst);
+        }
+    };
+
+    template<uint8_t MaxLen>
+    struct Raw: VarData<0x54, MaxLen>
+    {
+        static constexpr bool write_to(BytesView v, uint8_t *pDst)
+        {
+            return VarData<0x54, MaxLen>::write_to(v.m_pData, v.m_Size, pDst);
+        }
+    };
 
     //binary types
     enum class EBatteryState: uint8_t {Normal=0, Low=1};
@@ -198,6 +333,9 @@ namespace BTHome
     enum class EWindow: uint8_t {Closed=0, Opened=1};
     struct Window:         BinaryData<0x2D, EWindow> {using BinaryData::BinaryData;};
 
+    //receivers drop packets with an id they've just seen
+    struct PacketId:         IntData<0x00/*Id*/, bth_uint8_t> { using IntData::IntData; };
+
     //events
     enum class EButton: uint8_t {None=0, Press=1, DoublePress=2, TriplePress=3, LongPress=4, LongDoublePress=5, LongTriplePress=6, HoldPress = 0x80};
     struct Button:         EnumData<0x3A, EButton> {using EnumData::EnumData;};
@@ -235,5 +373,25 @@ namespace BTHome
             pDst[2] = v.major;
         }
     };
+
+    //Smallest change of the encoded value (in units of X::kFactor) that AdaptiveScheduler treats as significant.
+    //0 - any change is. Specialize it for your own thresholds.
+    template<class X>
+    struct Deadband { static constexpr uint32_t kRaw = 0; };
+    template<> struct Deadband<Temperature> { static constexpr uint32_t kRaw = 10; };//0.1 C
+    template<> struct Deadband<Humidity> { static constexpr uint32_t kRaw = 100; };//1 %
+
+    //every object type known to the library, the decoder tables are generated from it
+    using KnownTypes = tools::TypeList<
+        PacketId, Text<0>, Raw<0>/*size comes from the length byte*/, Acceleration, AccelerationSigned, Battery, Channel, CO2, Conductivity, Count1, Count2, Count4, CountSigned1,
+        CountSigned2, CountSigned4, Current, CurrentSigned, Dewpoint, Direction, DistanceMM, DistanceM, Duration,
+        Energy, Energy3, Gas, Gas3, Gyroscope, Humidity, Humidity1, Illuminance, MassKg, MassLb, Moisture, Moisture1,
+        PM2_5, PM10, Power, PowerSigned, Precipitation, Pressure, Rotation, RotationalSpeed, Speed, SpeedSigned,
+        TemperatureCoarse, Temperature35, TemperatureDec, Temperature, Timestamp, TVOC, VoltageFine, VoltageCoarse,
+        VolumeFine, Volume, VolumeMilli, VolumeStorage, VolumeFloatRate, UVIndex, Water, BatteryState, BatteryCharging,
+        CODetection, Cold, Connectivity, Door, GarageDoor, GasDetection, GenericBool, Heat, Light, Lock,
+        MoistureDetection, Motion, Moving, Occupancy, Opennig, Plug, PowerDetected, Presence, Problem, Running, Safety,
+        Smoke, Sound, Tamper, Vibration, Window, Button, Dimmer, DeviceTypeId, DeviceFirmware4, DeviceFirmware3
+    >;
 }
 #endif